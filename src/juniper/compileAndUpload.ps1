@@ -2,7 +2,10 @@
 
 Write-Output "Compiling"
 
-Juniper.exe -s buzzer.jun -o ../compiled/src/main.cpp
+## Any modules from ./lib that the program opens must be listed here
+$libs = @()
+
+Juniper.exe -s buzzer.jun $libs -o ../compiled/src/main.cpp
 
 Write-Output "Compiled to ../compiled/src/main.cpp"
 
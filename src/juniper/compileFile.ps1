@@ -1,3 +1,6 @@
 ## Compiles juniper file, outputs a main.cpp to ../compiled folder
+## Any modules from ./lib that the program opens must be listed in $libs
 
-Juniper.exe -s buzzer.jun -o ../compiled/src/main.cpp
\ No newline at end of file
+$libs = @()
+
+Juniper.exe -s buzzer.jun $libs -o ../compiled/src/main.cpp
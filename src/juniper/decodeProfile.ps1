@@ -0,0 +1,54 @@
+## Reads one Profile:dump() frame from the board and prints it as a table
+## Usage: ./decodeProfile.ps1 -port COM3 -baud 9600
+
+param(
+    [string]$port = "COM3",
+    [int]$baud = 9600
+)
+
+$serial = New-Object System.IO.Ports.SerialPort $port, $baud
+$serial.ReadTimeout = 5000
+$serial.Open()
+
+try {
+    ## Wait for the 0xA5 0x5A header
+    $prev = 0
+    while ($true) {
+        $b = $serial.ReadByte()
+        if ($prev -eq 0xA5 -and $b -eq 0x5A) { break }
+        $prev = $b
+    }
+
+    $sites = $serial.ReadByte()
+    $check = 0
+    $rows = @()
+    for ($i = 0; $i -lt $sites; $i++) {
+        $fields = @()
+        for ($f = 0; $f -lt 3; $f++) {
+            [uint32]$value = 0
+            for ($k = 0; $k -lt 4; $k++) {
+                $byte = $serial.ReadByte()
+                $check = $check -bxor $byte
+                $value = $value -bor ([uint32]$byte -shl (8 * $k))
+            }
+            $fields += $value
+        }
+        if ($fields[0] -ne 0 -or $fields[1] -ne 0) {
+            $rows += [PSCustomObject]@{
+                Site = $i
+                Fires = $fields[0]
+                Skips = $fields[1]
+                Micros = $fields[2]
+                MicrosPerCall = [math]::Round($fields[2] / ($fields[0] + $fields[1]), 1)
+            }
+        }
+    }
+
+    if ($serial.ReadByte() -ne $check) {
+        Write-Output "Checksum mismatch, frame is corrupt"
+    }
+    $rows | Format-Table -AutoSize
+}
+finally {
+    $serial.Close()
+}
@@ -0,0 +1,250 @@
+// Runs lib/AdcScan.jun's ADC interrupt on the PC against a model of the
+// ATmega328P ADC: conversions start on an ADC clock edge after ADSC is set,
+// hold the input 1.5 ADC clocks in and finish 13 clocks later (25 for the
+// first after enabling). Checks that channels are converted round robin in
+// list order, that read() only ever returns whole samples of the right
+// channel, and that oversampling gives the extra bits. Prints the sample
+// rate, how old a reading can be, and the CPU time the interrupt takes.
+#include "avrHost.h"
+
+#include <cmath>
+#include <vector>
+
+#include "AdcScan.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Interrupt times are hand counted estimates: respond and jmp ~9, prologue
+// ~30; adding ADC to the sum and counting it ~30; finishing a sample (the
+// shift, storing it, the sample count, the next channel) ~60; setting ADSC
+// ~5; epilogue and reti ~34
+static const uint32_t entryCycles = 39, addCycles = 30, finishCycles = 60;
+static const uint32_t startCycles = 5, epilogueCycles = 34;
+
+// 16MHz / 128: an ADC clock every 8us
+static const uint32_t adcClock = 8;
+
+// Input in LSBs for a channel at a time, and the noise on it: uniform,
+// +-dither LSB. The ADC rounds to the nearest code.
+static double (*input)(uint8_t channel, uint32_t t) = nullptr;
+static double dither = 0;
+
+static bool converting = false, fresh = false, isrPending = false;
+static uint32_t sampleAt = 0, doneAt = 0, isrAt = 0;
+static uint8_t channel = 0;
+static double held = 0;
+static std::vector<uint8_t> converted;
+static uint64_t isrCycles = 0;
+
+static double noise() {
+    return dither * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// One microsecond of the ADC
+static void tick() {
+    uint32_t t = hostMicros;
+    if (!(ADCSRA & (1 << ADEN))) {
+        converting = false;
+        isrPending = false;
+        return;
+    }
+    // The interrupt sets ADSC just before its epilogue
+    if (isrPending && t >= isrAt) {
+        isrPending = false;
+        converted.push_back(channel);
+        ADC_vect_host();
+    }
+    if (!converting && (ADCSRA & (1 << ADSC)) && t % adcClock == 0) {
+        converting = true;
+        channel = ADMUX & 0x07;
+        sampleAt = t + (fresh ? 108 : 12);
+        doneAt = t + (fresh ? 25 : 13) * adcClock;
+        fresh = false;
+    }
+    if (converting && t == sampleAt) {
+        held = input(channel, t) + noise();
+    }
+    if (converting && t == doneAt) {
+        converting = false;
+        ADC = (uint16_t)std::min(std::max(std::floor(held + 0.5), 0.0), 1023.0);
+        ADCSRA &= ~(1 << ADSC);
+        if (ADCSRA & (1 << ADIE)) {
+            bool finishes = junAdcTaken + 1 >= junAdcTarget;
+            uint32_t toStart = entryCycles + addCycles + (finishes ? finishCycles : 0);
+            isrPending = true;
+            isrAt = t + (toStart + 15) / 16;
+            isrCycles += toStart + startCycles + epilogueCycles;
+        }
+    }
+}
+
+static void run(uint32_t us) {
+    for (uint32_t i = 0; i < us; i++) {
+        tick();
+        hostMicros++;
+    }
+}
+
+// junAdcBegin turns the ADC off and on again, which drops a conversion under
+// way and makes the next one a long one
+static void begin(const std::vector<uint16_t>& pins, uint8_t extraBits) {
+    converting = false;
+    isrPending = false;
+    converted.clear();
+    isrCycles = 0;
+    junAdcBegin(pins.data(), pins.size(), extraBits);
+    fresh = true;
+}
+
+static double levels(uint8_t channel, uint32_t) {
+    return 100 * channel + 37;
+}
+
+static void roundRobin() {
+    input = levels;
+    dither = 0;
+    // A0, A3, 5 and A7 are channels 0, 3, 5 and 7
+    std::vector<uint16_t> pins = { A0, A0 + 3, 5, A0 + 7 };
+    const uint8_t channels[] = { 0, 3, 5, 7 };
+    for (uint8_t k = 0; k <= 2; k++) {
+        begin(pins, k);
+        // junAdcSamples counts on across begin calls
+        uint32_t wrong = 0, before = 0, start = junAdcSampleCount();
+        // Nothing finished yet reads 0
+        for (uint16_t p : pins) {
+            before += junAdcRead(p) != 0;
+        }
+        run(10000 << (2 * k));
+        for (int i = 0; i < 4; i++) {
+            wrong += junAdcRead(pins[i]) != (uint16_t)(levels(channels[i], 0)) << k;
+        }
+        uint32_t outOfOrder = 0, repeat = 1 << (2 * k);
+        for (size_t i = 0; i < converted.size(); i++) {
+            outOfOrder += converted[i] != channels[i / repeat % 4];
+        }
+        printf("  extraBits %u: %zu conversions, %u out of list order, %u channels read wrong\n", k,
+               converted.size(), outOfOrder, wrong);
+        check(before == 0, "a channel read something before its first sample");
+        check(outOfOrder == 0, "channels converted out of list order");
+        check(wrong == 0, "a channel read another channel's level");
+        check(junAdcRead(A0 + 1) == 0, "a pin not in the list read something");
+        check((junAdcSampleCount() - start) * repeat + junAdcTaken == converted.size(), "samples() doesn't match conversions");
+    }
+}
+
+static double steady(uint8_t, uint32_t) {
+    return 512.3;
+}
+
+static void oversampling() {
+    input = steady;
+    dither = 1;
+    srand(3);
+    for (uint8_t k = 0; k <= 4; k++) {
+        begin({ A0 }, k);
+        run(300 << (2 * k));
+        double low = 1e9, high = 0, tolerance = 3.0 / (1 << k) + 0.2;
+        uint32_t wrong = 0;
+        uint32_t first = junAdcSampleCount();
+        for (int i = 0; i < 200; i++) {
+            run(150 << (2 * k));
+            double v = (double)junAdcRead(A0) / (1 << k);
+            low = std::min(low, v);
+            high = std::max(high, v);
+            // A sample still being summed would read far too low
+            wrong += std::fabs(v - 512.3) > tolerance;
+        }
+        printf("  extraBits %u: %u samples of 512.3 LSB with +-1 LSB of noise read %.3f to %.3f\n", k,
+               junAdcSampleCount() - first, low, high);
+        check(wrong == 0, "an oversampled reading is off by more than its resolution");
+    }
+}
+
+static uint8_t stepChannel = 0;
+static double stepAt = 0;
+static double step(uint8_t channel, uint32_t t) {
+    return channel == stepChannel && t >= stepAt ? 800 : 200;
+}
+
+static void rates() {
+    input = levels;
+    dither = 0;
+    printf("  Io:anaRead waits for a whole conversion, 104-112us, every call\n");
+    for (uint8_t n : { 1, 4, 8 }) {
+        for (uint8_t k : { 0, 2 }) {
+            std::vector<uint16_t> pins;
+            for (uint8_t i = 0; i < n; i++) {
+                pins.push_back(A0 + i);
+            }
+            begin(pins, k);
+            uint32_t start = junAdcSampleCount();
+            run(1000000);
+            double perSecond = junAdcSampleCount() - start;
+            double conversions = converted.size();
+
+            // How long after the input changes read() shows it, for changes
+            // at random times on the last channel
+            input = step;
+            stepChannel = n - 1;
+            srand(n + k);
+            uint32_t worst = 0, total = 0, tries = 50;
+            for (uint32_t i = 0; i < tries; i++) {
+                stepAt = 1e9;
+                begin(pins, k);
+                run(2000 << (2 * k));
+                stepAt = hostMicros + rand() % (1000 << (2 * k));
+                // Gives up on a reading that never comes after 0.1s
+                while ((hostMicros < stepAt || junAdcRead(A0 + stepChannel) != 800 << k) &&
+                       hostMicros < stepAt + 100000) {
+                    run(1);
+                }
+                uint32_t age = hostMicros - (uint32_t)stepAt;
+                worst = std::max(worst, age);
+                total += age;
+            }
+            input = levels;
+
+            printf("  %u channels, extraBits %u: %.0f conversions/s, %.0f samples/s per channel, changes seen after "
+                   "%uus on average, %uus at worst\n", n, k, conversions, perSecond / n, total / tries, worst);
+            // 13 ADC clocks a conversion, and up to 3 more to start the next
+            check(conversions >= 1e6 / 128 && conversions <= 1e6 / 104, "conversions/s outside what the ADC can do");
+            // The change can just miss a hold, then waits out the rest of the
+            // list and a whole sample of its own channel
+            check(worst <= (n + 1) * (1u << (2 * k)) * 120, "a reading older than one round of the list");
+        }
+    }
+}
+
+static void cpu() {
+    input = levels;
+    dither = 0;
+    for (uint8_t k : { 0, 2 }) {
+        begin({ A0, A0 + 1, A0 + 2, A0 + 3 }, k);
+        run(1000000);
+        printf("  extraBits %u: the interrupt takes %.1f%% of the CPU (estimated), ~%.0f cycles per conversion\n", k,
+               100.0 * isrCycles / F_CPU, (double)isrCycles / converted.size());
+    }
+    // The loop over the list, cli and the two byte copy
+    printf("  AdcScan:read of the 4th channel: ~%u cycles (estimated), against ~1700 waiting in Io:anaRead\n",
+           20 + 4 * 8);
+}
+
+int main() {
+    printf("round robin\n");
+    roundRobin();
+    printf("oversampling\n");
+    oversampling();
+    printf("rate and latency\n");
+    rates();
+    printf("cpu\n");
+    cpu();
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
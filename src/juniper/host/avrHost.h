@@ -0,0 +1,231 @@
+// Just enough of the AVR and Arduino environment to compile the C++ parts of
+// the lib modules on a PC. Registers are plain variables and interrupts are
+// ordinary functions the simulation calls itself.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define F_CPU 16000000L
+
+inline uint8_t SREG = 0;
+inline void cli() {}
+inline void sei() {}
+
+#define ISR(vector) void vector##_host()
+
+// Timer2. The lib code only ever clears TCNT2, so a sim can set it to
+// something else before a call to see whether the call restarted the timer.
+#define WGM20 0
+#define WGM21 1
+#define COM2B1 5
+#define CS21 1
+#define TOIE2 0
+#define OCIE2A 1
+inline uint8_t TCNT2 = 0;
+inline uint8_t TCCR2A = 0;
+inline uint8_t TCCR2B = 0;
+inline uint8_t OCR2A = 0;
+inline uint8_t OCR2B = 0;
+inline uint8_t TIMSK2 = 0;
+
+// Timer1. Sims that need the count to move while an interrupt runs define
+// TCNT1 themselves before including the module.
+#define CS10 0
+#define CS11 1
+#define WGM12 3
+#define OCIE1A 1
+inline uint8_t TCCR1A = 0;
+inline uint8_t TCCR1B = 0;
+inline uint8_t TIMSK1 = 0;
+inline uint16_t TCNT1 = 0;
+inline uint16_t OCR1A = 0;
+#define OCF1A 1
+inline uint8_t TIFR1 = 0;
+// Input capture
+#define ICNC1 7
+#define ICES1 6
+#define ICIE1 5
+#define ICF1 5
+#define TOIE1 0
+#define TOV1 0
+inline uint16_t ICR1 = 0;
+
+// Timer0 as the Arduino core runs it for micros(): TCNT0 counts every 64
+// cycles and the core's overflow interrupt counts timer0_overflow_count
+#define TOV0 0
+inline uint8_t TCNT0 = 0;
+inline uint8_t TIFR0 = 0;
+inline volatile unsigned long timer0_overflow_count = 0;
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+inline uint8_t PCIFR = 0;
+
+// The ADC. A sim runs the conversions itself and calls ADC_vect_host.
+#define REFS0 6
+#define ADEN 7
+#define ADSC 6
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+inline uint8_t ADMUX = 0;
+inline uint8_t ADCSRA = 0;
+inline uint16_t ADC = 0;
+
+// The TWI. TWCR is an object so a sim sees every write, where the hardware
+// acts on TWINT, TWSTA and TWSTO, and every read, where it can let time pass
+// for code that waits on a bit.
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWEN 2
+#define TWIE 0
+inline void (*hostTwcrWritten)() = nullptr;
+inline void (*hostTwcrRead)() = nullptr;
+struct HostTwcr {
+    uint8_t value = 0;
+    HostTwcr& operator=(uint8_t v) {
+        value = v;
+        if (hostTwcrWritten) hostTwcrWritten();
+        return *this;
+    }
+    operator uint8_t() {
+        if (hostTwcrRead) hostTwcrRead();
+        return value;
+    }
+};
+inline HostTwcr TWCR;
+inline uint8_t TWSR = 0;
+inline uint8_t TWDR = 0;
+inline uint8_t TWBR = 0;
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+template<typename A, typename B>
+auto min(A a, B b) { return a < b ? a : b; }
+template<typename A, typename B>
+auto max(A a, B b) { return a > b ? a : b; }
+
+inline uint32_t hostMicros = 0;
+inline uint32_t micros() { return hostMicros; }
+inline uint32_t millis() { return hostMicros / 1000; }
+inline void delay(uint32_t ms) { hostMicros += ms * 1000; }
+// Called where code waits for pins to settle, so a simulated circuit can
+// update the PIN registers
+inline void (*hostSettle)() = nullptr;
+inline void delayMicroseconds(uint32_t us) {
+    hostMicros += us;
+    if (hostSettle) hostSettle();
+}
+
+// Uno pins: 0-7 on port D, 8-13 on port B, 14-19 (A0-A5) on port C
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+#define A0 14
+#define SDA 18
+#define SCL 19
+// The IO registers sit in hostIo at their AVR data addresses. It's aligned so
+// the low 16 bits of a register's host address are its AVR address, which is
+// what FastIo keeps.
+alignas(0x10000) inline uint8_t hostIo[0x100];
+inline uint8_t& PINB = hostIo[0x23];
+inline uint8_t& DDRB = hostIo[0x24];
+inline uint8_t& PORTB = hostIo[0x25];
+inline uint8_t& PINC = hostIo[0x26];
+inline uint8_t& DDRC = hostIo[0x27];
+inline uint8_t& PORTC = hostIo[0x28];
+inline uint8_t& PIND = hostIo[0x29];
+inline uint8_t& DDRD = hostIo[0x2A];
+inline uint8_t& PORTD = hostIo[0x2B];
+inline uint8_t digitalPinToPort(uint8_t pin) { return pin < 8 ? PD : pin < 14 ? PB : pin < 20 ? PC : NOT_A_PORT; }
+inline uint8_t digitalPinToBitMask(uint8_t pin) { return 1 << (pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14); }
+inline volatile uint8_t* portModeRegister(uint8_t port) { return port == PB ? &DDRB : port == PC ? &DDRC : &DDRD; }
+inline volatile uint8_t* portOutputRegister(uint8_t port) {
+    return port == PB ? &PORTB : port == PC ? &PORTC : &PORTD;
+}
+inline volatile uint8_t* portInputRegister(uint8_t port) { return port == PB ? &PINB : port == PC ? &PINC : &PIND; }
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    uint8_t port = digitalPinToPort(pin), mask = digitalPinToBitMask(pin);
+    if (port == NOT_A_PORT) return;
+    volatile uint8_t& ddr = *portModeRegister(port);
+    volatile uint8_t& out = *portOutputRegister(port);
+    ddr = mode == OUTPUT ? ddr | mask : ddr & ~mask;
+    if (mode != OUTPUT) {
+        out = mode == INPUT_PULLUP ? out | mask : out & ~mask;
+    }
+}
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+    uint8_t port = digitalPinToPort(pin), mask = digitalPinToBitMask(pin);
+    if (port == NOT_A_PORT) return;
+    volatile uint8_t& out = *portOutputRegister(port);
+    out = value == LOW ? out & ~mask : out | mask;
+}
+
+// analogWrite goes to hostAnalogWrite, for a sim to record
+inline void (*hostAnalogWrite)(uint8_t pin, int value) = nullptr;
+inline void analogWrite(uint8_t pin, int value) {
+    if (hostAnalogWrite) hostAnalogWrite(pin, value);
+}
+
+// SPI sends every byte to hostSpiByte, for a simulated device to pick up
+#define MSBFIRST 1
+#define SPI_MODE0 0
+struct SPISettings {
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+inline void (*hostSpiByte)(uint8_t) = nullptr;
+struct HostSpi {
+    void begin() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t b) {
+        if (hostSpiByte) hostSpiByte(b);
+        return 0;
+    }
+    void transfer(void* buffer, uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) transfer(((uint8_t*)buffer)[i]);
+    }
+    uint16_t transfer16(uint16_t w) {
+        transfer(w >> 8);
+        transfer(w & 0xFF);
+        return 0;
+    }
+};
+inline HostSpi SPI;
+
+// Serial hands every byte to hostSerialByte and asks hostSerialRoom how much
+// of the transmit buffer is free, so a sim can time the UART and make a write
+// wait for room the way HardwareSerial does. Received bytes come from
+// hostSerialAvailable and hostSerialRead.
+inline int (*hostSerialRoom)() = nullptr;
+inline void (*hostSerialByte)(uint8_t) = nullptr;
+inline int (*hostSerialAvailable)() = nullptr;
+inline int (*hostSerialRead)() = nullptr;
+struct HostSerial {
+    void begin(uint32_t) {}
+    int available() { return hostSerialAvailable ? hostSerialAvailable() : 0; }
+    int read() { return hostSerialRead ? hostSerialRead() : -1; }
+    int availableForWrite() { return hostSerialRoom ? hostSerialRoom() : 63; }
+    size_t write(uint8_t b) {
+        if (hostSerialByte) hostSerialByte(b);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) {
+        for (size_t i = 0; i < size; i++) write(buffer[i]);
+        return size;
+    }
+};
+inline HostSerial Serial;
@@ -0,0 +1,161 @@
+// Runs lib/Display.jun against a simulated ILI9341 on the PC. Builds the
+// same screen as dashboard.jun, applies a few updates, and for each flush
+// prints the bytes sent and writes the screen to display-<n>.ppm. Every frame
+// is checked against a full redraw of the scene, so a tile that should have
+// been marked dirty and wasn't shows up as a failure.
+//
+// The scene in main() is a hand-copied mirror of dashboard.jun's setup, made
+// with the C calls that Display:label, Display:rect and Display:bar wrap.
+// Nothing checks that the two agree, so change both together.
+#include "avrHost.h"
+
+#include <vector>
+
+#include "Display.inc"
+
+static uint8_t csPort = 0;
+static uint8_t dcPort = 1;
+
+// Just the controller commands Display uses: column and page address set
+// and memory write
+struct Controller {
+    std::vector<uint16_t> pixels;
+    uint16_t width = 0;
+    uint8_t command = 0;
+    uint8_t args[4];
+    uint8_t argCount = 0;
+    uint16_t x0 = 0, x1 = 0, y0 = 0, y1 = 0, x = 0, y = 0;
+    uint8_t high = 0;
+    bool odd = false;
+    uint32_t bytes = 0;
+
+    void byte(uint8_t b) {
+        bytes++;
+        if ((dcPort & 1) == 0) {
+            command = b;
+            argCount = 0;
+            x = x0;
+            y = y0;
+            odd = false;
+            return;
+        }
+        if (command == 0x2A || command == 0x2B) {
+            if (argCount < 4) {
+                args[argCount++] = b;
+            }
+            if (argCount == 4) {
+                uint16_t from = args[0] << 8 | args[1];
+                uint16_t to = args[2] << 8 | args[3];
+                if (command == 0x2A) {
+                    x0 = from;
+                    x1 = to;
+                } else {
+                    y0 = from;
+                    y1 = to;
+                }
+            }
+        } else if (command == 0x2C) {
+            if (!odd) {
+                high = b;
+            } else if (y <= y1) {
+                pixels[y * width + x] = high << 8 | b;
+                if (++x > x1) {
+                    x = x0;
+                    y++;
+                }
+            }
+            odd = !odd;
+        }
+    }
+};
+
+static Controller screen;
+
+static uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) {
+    return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+static void writePpm(const char* name) {
+    FILE* f = fopen(name, "wb");
+    fprintf(f, "P6\n%d %d\n255\n", junDisplayWidth, junDisplayHeight);
+    for (uint16_t c : screen.pixels) {
+        uint8_t rgb[3] = { (uint8_t)((c >> 8) & 0xF8), (uint8_t)((c >> 3) & 0xFC), (uint8_t)(c << 3) };
+        fwrite(rgb, 1, 3, f);
+    }
+    fclose(f);
+}
+
+static int failures = 0;
+static int frame = 0;
+
+static void flush(const char* what) {
+    screen.bytes = 0;
+    uint32_t sent = junDisplayFlush();
+    char name[32];
+    snprintf(name, sizeof(name), "display-%d.ppm", frame);
+    writePpm(name);
+    printf("%-28s %7u bytes  %s\n", what, sent, name);
+    if (sent != screen.bytes) {
+        printf("  FAILED: flush counted %u bytes but sent %u\n", sent, screen.bytes);
+        failures++;
+    }
+    // Redraw everything onto a scrambled screen and compare
+    std::vector<uint16_t> kept = screen.pixels;
+    std::fill(screen.pixels.begin(), screen.pixels.end(), 0x1234);
+    memset(junDisplayDirty, 0xFF, sizeof(junDisplayDirty));
+    junDisplayFlush();
+    if (screen.pixels != kept) {
+        printf("  FAILED: screen differs from a full redraw\n");
+        failures++;
+    }
+    screen.pixels = kept;
+    frame++;
+}
+
+int main() {
+    hostSpiByte = [](uint8_t b) { screen.byte(b); };
+    if (junDisplaySetSize(320, 480)) {
+        printf("FAILED: a 320x480 screen needs 1200 tiles but was accepted\n");
+        failures++;
+    }
+    if (!junDisplaySetSize(240, 320)) {
+        printf("FAILED: a 240x320 screen was refused\n");
+        return 1;
+    }
+    junDisplayCsPort = &csPort;
+    junDisplayCsMask = 1;
+    junDisplayDcPort = &dcPort;
+    junDisplayDcMask = 1;
+    screen.width = 240;
+    screen.pixels.assign(240 * 320, 0);
+
+    // dashboard.jun's setup, copied by hand
+    uint16_t white = rgb565(255, 255, 255);
+    uint16_t black = 0;
+    uint8_t title = junDisplayAdd(JUN_DISPLAY_LABEL, 10, 10, 0, 16, rgb565(255, 255, 0), black);
+    junDisplayItems[title].size = 2;
+    junDisplaySetText(title, "Potentiometer");
+    junDisplayAdd(JUN_DISPLAY_RECT, 10, 30, 220, 2, rgb565(0, 0, 255), rgb565(0, 0, 255));
+    uint8_t bar = junDisplayAdd(JUN_DISPLAY_BAR, 10, 50, 220, 30, rgb565(0, 255, 0), rgb565(40, 40, 40));
+    uint8_t pot = junDisplayAdd(JUN_DISPLAY_LABEL, 10, 100, 0, 32, white, black);
+    junDisplayItems[pot].size = 4;
+    uint8_t uptime = junDisplayAdd(JUN_DISPLAY_LABEL, 10, 300, 0, 8, white, black);
+
+    flush("first frame");
+    junDisplaySetBar(bar, 128);
+    junDisplaySetText(pot, "512");
+    junDisplaySetText(uptime, "1");
+    flush("bar to 128, pot 512");
+    junDisplaySetBar(bar, 130);
+    junDisplaySetText(pot, "520");
+    flush("bar to 130, pot 520");
+    junDisplaySetText(uptime, "2");
+    flush("uptime 2");
+    junDisplaySetBar(bar, 20);
+    junDisplaySetText(pot, "80");
+    flush("bar to 20, pot 80");
+    flush("nothing changed");
+
+    printf(failures == 0 ? "all frames passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
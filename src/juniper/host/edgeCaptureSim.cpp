@@ -0,0 +1,223 @@
+// Runs lib/EdgeCapture.jun's pin change interrupt on the PC against the
+// interrupt model in pinChange.h. Feeds it bursts of edges 10us apart
+// (100kHz) and checks that dropped() stays 0 and every edge comes out of
+// EdgeCapture:next with the right level and a time within a few
+// microseconds of the edge. Also reports how much slower the interrupt
+// could be before 100kHz bursts start losing edges.
+#include "pinChange.h"
+
+#include "EdgeCapture.inc"
+
+// This version: prologue saving r0, r1, SREG and the 12 call-clobbered
+// registers (the Encoder hook is called through a pointer) plus 2 more,
+// ~44; flag clear and port read, 7; hook test, 5; timer0 count and TCNT0
+// with the overflow check, ~16; queue the reading, ~35; epilogue and reti,
+// ~40.
+static const PinChangeCost current = { "inline timer read", 60, 156 };
+// The version this replaced: the same prologue, then a call to micros()
+// (~46 with its cli, SREG save and shifts), the port read, the diff against
+// the last reading and one queue entry per changed pin, made in the
+// interrupt (~80 for one pin), epilogue.
+static const PinChangeCost withMicros = { "micros() per edge", 105, 220 };
+
+static const uint32_t edgeSpacing = 160; // 10us, 100kHz
+static uint8_t portB = 0;
+static const uint8_t pinBit = 1; // pin 9
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+struct Event {
+    uint8_t level;
+    uint32_t time;
+};
+
+struct Outcome {
+    uint32_t edges;
+    uint32_t seen;
+    uint32_t dropped;
+    bool levelsOk;
+    // Worst difference between the event time and the edge, in us
+    double earliest, latest;
+};
+
+// Runs one burst of edges on pin 9 starting at cycle start. With drain set
+// loop() takes edges out between interrupts, otherwise only at the end.
+static Outcome burst(const PinChangeCost& cost, uint64_t start, uint32_t count, uint32_t spacing, bool drain,
+                     uint64_t timerPhase = 0) {
+    memset((void*)junEdgeQueue, 0, sizeof(junEdgeQueue));
+    junEdgeHead = junEdgeTail = 0;
+    junEdgeDropped = 0;
+    junEdgePorts[0] = &portB;
+    junEdgeWatch[0] = 1 << pinBit;
+    junEdgePins[0][pinBit] = 9;
+    portB = 0;
+    junEdgeSeen[0] = portB;
+
+    // Time runs from timerPhase so bursts can start anywhere in the timer0
+    // period
+    std::vector<uint64_t> edges;
+    for (uint32_t i = 0; i < count; i++) {
+        edges.push_back(start + timerPhase + (uint64_t)i * spacing);
+    }
+    auto edgeAt = [&](uint32_t i) { return edges[i]; };
+    auto edgesBy = [&](uint64_t t) -> uint32_t {
+        return std::upper_bound(edges.begin(), edges.end(), t) - edges.begin();
+    };
+    std::vector<Event> events;
+    std::vector<uint64_t> readAt;
+    auto take = [&]() {
+        uint8_t pin, level;
+        uint32_t time;
+        while (junEdgeTake(pin, level, time)) {
+            check(pin == 9, "event for the wrong pin");
+            events.push_back({ level, time });
+        }
+    };
+    runPinChange(cost, edges, start + timerPhase,
+        [&](size_t n, uint64_t at) {
+            portB = (n & 1) << pinBit;
+            junEdgeService(0);
+            readAt.push_back(at);
+        },
+        [&]() {
+            if (drain) {
+                take();
+            }
+        });
+    take();
+
+    Outcome o = { count, (uint32_t)events.size(), junEdgeDropped, true, 1e9, -1e9 };
+    // Levels alternate, starting high, and every edge lost takes its pair
+    // with it
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].level != ((i & 1) == 0 ? 1 : 0)) {
+            o.levelsOk = false;
+        }
+    }
+    // Times: each event against the edge it was read after
+    uint32_t e = 0;
+    size_t r = 0;
+    for (size_t i = 0; i < events.size() && r < readAt.size(); i++) {
+        while (r < readAt.size() && (edgesBy(readAt[r]) & 1) == (edgesBy(r == 0 ? 0 : readAt[r - 1]) & 1)) {
+            r++;
+        }
+        if (r == readAt.size()) {
+            break;
+        }
+        e = edgesBy(readAt[r]) - 1;
+        double late = events[i].time - edgeAt(e) / 16.0;
+        o.earliest = late < o.earliest ? late : o.earliest;
+        o.latest = late > o.latest ? late : o.latest;
+        r++;
+    }
+    return o;
+}
+
+int main() {
+    printf("interrupt costs (estimated, cycles from the flag): read at %u, done at %u; was %u and %u\n",
+           current.read, current.total, withMicros.read, withMicros.total);
+
+    // A 30 edge burst fits the 32 entry queue with loop() only reading it
+    // afterwards. Start it at 256 points across the timer0 period.
+    printf("100kHz bursts of 30 edges, read after the burst\n");
+    for (const PinChangeCost* cost : { &current, &withMicros }) {
+        int clear = 0, clearLost = 0, overlapping = 0, overlappingLost = 0;
+        uint32_t dropped = 0;
+        bool levelsOk = true;
+        double earliest = 1e9, latest = -1e9;
+        for (uint32_t phase = 0; phase < timer0Period; phase += 64) {
+            Outcome o = burst(*cost, timer0Period, 30, edgeSpacing, false, phase);
+            // Bursts within reach of the timer0 interrupt
+            uint64_t first = timer0Period + phase, last = first + 29 * edgeSpacing;
+            bool overlaps = last + cost->total >= 2 * timer0Period && first < 2 * timer0Period + timer0Cost;
+            (overlaps ? overlapping : clear)++;
+            if (o.seen != o.edges) {
+                (overlaps ? overlappingLost : clearLost)++;
+            }
+            dropped += o.dropped;
+            levelsOk = levelsOk && o.levelsOk;
+            earliest = o.earliest < earliest ? o.earliest : earliest;
+            latest = o.latest > latest ? o.latest : latest;
+        }
+        printf("  %-18s lost edges in %d of %d bursts clear of the timer0 interrupt, %d of %d overlapping it\n",
+               cost->name, clearLost, clear, overlappingLost, overlapping);
+        if (cost == &current) {
+            printf("  %-18s event times %.1f to %.1fus after the edge, dropped %u\n", "", earliest, latest, dropped);
+            check(dropped == 0, "dropped() not 0");
+            check(clearLost == 0, "lost edges in a burst clear of the timer0 interrupt");
+            check(levelsOk, "levels out of step with the edges");
+            check(earliest > -4 && latest < 12, "event times too far from the edges");
+        }
+    }
+
+    // With loop() reading as it goes, a long run at 100kHz crosses several
+    // timer0 interrupts
+    printf("100kHz for 2000 edges, read as they come\n");
+    Outcome o = burst(current, timer0Period, 2000, edgeSpacing, true, 1000);
+    printf("  seen %u of %u, dropped %u\n", o.seen, o.edges, o.dropped);
+    check(o.dropped == 0, "dropped() not 0");
+    check((o.edges - o.seen) % 2 == 0 && o.levelsOk, "a lost edge didn't take its pair with it");
+
+    // How slow the interrupt could get before bursts clear of timer0 lose
+    // edges, keeping the port read where it is
+    uint32_t budget = current.total;
+    for (uint32_t total = current.total; total < 400; total++) {
+        PinChangeCost slower = { "", current.read, total };
+        bool ok = true;
+        for (uint32_t phase = 2000; ok && phase < 2000 + 64 * 32; phase += 64) {
+            Outcome b = burst(slower, timer0Period, 30, edgeSpacing, false, phase);
+            ok = b.seen == b.edges;
+        }
+        if (!ok) {
+            break;
+        }
+        budget = total;
+    }
+    printf("30 edge bursts still pass with up to %u cycles per interrupt\n", budget);
+    check(budget >= current.total, "estimated interrupt cost over budget");
+
+    // The fastest rate at which bursts come through whole wherever the
+    // timer0 interrupt lands
+    uint32_t spacing = edgeSpacing;
+    for (bool ok = false; !ok; spacing++) {
+        ok = true;
+        for (uint32_t phase = 0; ok && phase < timer0Period; phase += 16) {
+            Outcome b = burst(current, timer0Period, 30, spacing, false, phase);
+            ok = b.seen == b.edges;
+        }
+    }
+    spacing--;
+    printf("edges %u cycles apart (%.0fkHz) or further come through the timer0 interrupt whole\n", spacing,
+           16000.0 / spacing);
+
+    // The queue holds 31 readings. The rest are dropped and counted.
+    printf("overflow\n");
+    o = burst(current, timer0Period, 40, 800, false, 2000);
+    printf("  40 edges 50us apart, nothing read: seen %u, dropped %u\n", o.seen, o.dropped);
+    check(o.seen == JUN_EDGE_QUEUE - 1 && o.dropped == 40 - (JUN_EDGE_QUEUE - 1), "overflow not counted");
+
+    // Two watched pins changing in one reading give two events, lowest
+    // pin first
+    printf("two pins at once\n");
+    junEdgeHead = junEdgeTail = 0;
+    junEdgeWatch[0] = 0x03;
+    junEdgePins[0][0] = 8;
+    junEdgeSeen[0] = 0;
+    portB = 0x03;
+    junEdgeService(0);
+    uint8_t pin1 = 0, pin2 = 0, level;
+    uint32_t time;
+    check(junEdgeWaiting() == 2, "available() doesn't count both pins");
+    check(junEdgeTake(pin1, level, time) && junEdgeTake(pin2, level, time) && !junEdgeTake(pin2, level, time),
+          "didn't get exactly two events");
+    check(pin1 == 8 && pin2 == 9, "events not lowest pin first");
+    printf("  events for pins %u and %u\n", pin1, pin2);
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
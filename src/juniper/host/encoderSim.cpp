@@ -0,0 +1,150 @@
+// Runs lib/Encoder.jun's decoder inside EdgeCapture's pin change interrupt on
+// the PC, against the interrupt model in pinChange.h, with synthetic encoder
+// traces: spin up to a speed, hold it, slow down, turn round and come back.
+// At every interrupt the position has to match the edges that came before
+// the port read, so a count lost anywhere fails. Speeds are quadrature
+// frequencies, 4 counts per cycle, so 20kHz is an edge every 12.5us.
+#include "pinChange.h"
+
+#include "EdgeCapture.inc"
+#include "Encoder.inc"
+
+// An encoder-only group: prologue with the 12 call-clobbered registers
+// saved for the hook call, ~44; flag clear and port read, 7; hook test, 5;
+// junEncoderService through the pointer, ~90 (call and its own prologue
+// ~20, group and pin tests ~20, table step and direction ~10, 32 bit
+// position update ~25, loop and return ~10); watch test, 4; epilogue and
+// reti, ~40.
+static const PinChangeCost cost = { "encoder", 60, 199 };
+
+// A on pin 2 and B on pin 3, PD2 and PD3
+static uint8_t portD = 0;
+static const uint8_t maskA = 1 << 2, maskB = 1 << 3;
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// AB states in the order the table counts up: 00, 10, 11, 01
+static const uint8_t forward[4] = { 0, maskA, maskA | maskB, maskB };
+
+struct Trace {
+    std::vector<uint64_t> edges;
+    // Port after each edge and the position the table gives for it
+    std::vector<uint8_t> ports;
+    std::vector<int32_t> positions;
+};
+
+// Builds a trace that ramps up to hz over ramp edges, holds for hold edges,
+// ramps down, then does the same backwards. Edge times wander by up to
+// jitter of the period either way, as real encoders' quadrature isn't even.
+static Trace makeTrace(double hz, uint32_t ramp, uint32_t hold, double jitter, uint64_t start) {
+    Trace t;
+    srand(1);
+    double time = start;
+    int phase = 0;
+    int32_t position = 0;
+    for (int dir : { 1, -1 }) {
+        uint32_t edges = 2 * ramp + hold;
+        for (uint32_t i = 0; i < edges; i++) {
+            // Slowest at a tenth of hz at either end of the ramps
+            double fraction = i < ramp ? (i + 1.0) / ramp : i >= ramp + hold ? (edges - i) / (double)ramp : 1;
+            double speed = hz * (0.1 + 0.9 * fraction);
+            double period = F_CPU / (4 * speed);
+            double wander = jitter * period * (2.0 * rand() / RAND_MAX - 1);
+            time += period;
+            phase = (phase + dir + 4) % 4;
+            position += dir;
+            t.edges.push_back((uint64_t)(time + wander));
+            t.ports.push_back(forward[phase]);
+            t.positions.push_back(position);
+        }
+    }
+    // Wander can't put edges out of order
+    for (size_t i = 1; i < t.edges.size(); i++) {
+        if (t.edges[i] <= t.edges[i - 1]) {
+            t.edges[i] = t.edges[i - 1] + 1;
+        }
+    }
+    return t;
+}
+
+struct Result {
+    uint32_t wrong;
+    int32_t turn;
+    int32_t end;
+    uint32_t skipped;
+};
+
+static Result run(const Trace& t, uint64_t start, const PinChangeCost& cost) {
+    // What Encoder:attach sets up
+    portD = 0;
+    junEdgePorts[2] = &portD;
+    junEdgeWatch[2] = 0;
+    JunEncoder& e = junEncoders[0];
+    e.group = 2;
+    e.maskA = maskA;
+    e.maskB = maskB;
+    e.state = 0;
+    e.direction = 0;
+    e.position = 0;
+    e.skipped = 0;
+    junEncoderCount = 1;
+    junEdgeHook = junEncoderService;
+    junEdgeClaimed[2] = maskA | maskB;
+
+    Result r = { 0, 0, 0, 0 };
+    runPinChange(cost, t.edges, start,
+        [&](size_t n, uint64_t) {
+            portD = n == 0 ? 0 : t.ports[n - 1];
+            junEdgeService(2);
+            if (e.position != (n == 0 ? 0 : t.positions[n - 1])) {
+                r.wrong++;
+            }
+            r.turn = e.position > r.turn ? e.position : r.turn;
+        },
+        [] {});
+    r.end = e.position;
+    r.skipped = e.skipped;
+    return r;
+}
+
+int main() {
+    printf("interrupt cost (estimated, cycles from the flag): read at %u, done at %u\n", cost.read, cost.total);
+    double fastest = 0;
+    for (double hz : { 1000.0, 5000.0, 10000.0, 15000.0, 20000.0 }) {
+        // 40000 edges each way crosses the timer0 interrupt many times
+        Trace t = makeTrace(hz, 2000, 40000, 0.1, timer0Period);
+        Result r = run(t, timer0Period, cost);
+        int32_t turn = *std::max_element(t.positions.begin(), t.positions.end());
+        printf("%6.0fHz  turned at %d of %d, ended at %d of %d  wrong reads %u  missed steps made up %u\n", hz,
+               r.turn, turn, r.end, t.positions.back(), r.wrong, r.skipped);
+        check(r.turn == turn && r.end == t.positions.back() && r.wrong == 0, "counts lost");
+        if (r.wrong == 0) {
+            fastest = hz;
+        }
+    }
+    // The cost is an estimate. With the interrupt a quarter slower it can't
+    // keep up at 20kHz and misses steps, which have to be made up.
+    PinChangeCost slower = { "slower", cost.read * 5 / 4, cost.total * 5 / 4 };
+    Trace t = makeTrace(20000, 2000, 40000, 0.1, timer0Period);
+    Result r = run(t, timer0Period, slower);
+    printf("20000Hz with the interrupt 25%% slower: wrong reads %u  missed steps made up %u\n", r.wrong, r.skipped);
+    check(r.end == 0 && r.wrong == 0, "counts lost with a slower interrupt");
+    // How far past 20kHz it goes before counts are lost
+    for (double hz = 20000; hz < 200000; hz += 1000) {
+        Trace t = makeTrace(hz, 2000, 40000, 0.1, timer0Period);
+        Result r = run(t, timer0Period, cost);
+        if (r.wrong != 0 || r.end != t.positions.back()) {
+            break;
+        }
+        fastest = hz;
+    }
+    printf("no counts lost up to %.0fHz\n", fastest);
+
+    printf(failures == 0 ? "all traces passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+// Runs lib/Fader.jun's 1kHz Timer1 interrupt on the PC and records every
+// analogWrite with the cycle it would land on. Checks that linear, gamma and
+// eased fades follow their curves, end on their target at exactly their
+// length, start where the pin was, and that channels are handed out the way
+// the header says. Then works out how much of the CPU the interrupt takes
+// and how much the time of each pin's writes moves about from tick to tick,
+// for fadeEngine.jun's two fades and for six at once.
+#include "pinChange.h"
+
+#include <cmath>
+
+#include "Fader.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Interrupt times are hand counted estimates, as in pinChange.h:
+// - respond and jmp ~7, prologue ~40 (analogWrite is called, so every call
+//   clobbered register is saved); epilogue and reti ~45
+// - an idle channel, ~8 to load active and go on
+// - an active channel: the position and carry ~30, the level (linear ~55,
+//   gamma ~75, eased with its two 32-bit multiplies ~170), the compare and
+//   the finished check ~10
+// - analogWrite ~110, the OCR write lands ~100 in
+static const uint32_t entryCost = 47, epilogueCost = 45, idleCost = 8;
+static const uint32_t positionCost = 30, checkCost = 10;
+static const uint32_t levelCost[3] = { 55, 75, 170 };
+static const uint32_t writeCost = 110, writeLands = 100;
+static const uint32_t tickCycles = F_CPU / 1000;
+// Where timer0's overflows fall against Timer1's ticks
+static const uint32_t timer0Phase = 5000;
+
+struct Write {
+    uint8_t pin;
+    uint8_t value;
+    uint64_t tick;
+    uint32_t offset;
+};
+static std::vector<Write> writes;
+static uint64_t tick = 0, isrCycles = 0, worstIsr = 0;
+
+static void recordWrite(uint8_t pin, int value) {
+    writes.push_back({ pin, (uint8_t)value, tick, 0 });
+}
+
+// One Timer1 compare. Works out afterwards when in the interrupt each write
+// landed, from which channels were active going in.
+static void interrupt() {
+    bool active[JUN_FADER_CHANNELS];
+    uint8_t curve[JUN_FADER_CHANNELS];
+    for (uint8_t i = 0; i < JUN_FADER_CHANNELS; i++) {
+        active[i] = junFaderChannels[i].active;
+        curve[i] = junFaderChannels[i].curve;
+    }
+    size_t first = writes.size();
+    tick++;
+    TIMER1_COMPA_vect_host();
+
+    // A timer0 overflow interrupt that began just before the tick holds it up
+    uint64_t at = tick * tickCycles;
+    uint64_t timer0 = at < timer0Phase ? 0 : (at - timer0Phase) / timer0Period * timer0Period + timer0Phase;
+    uint32_t cycles = at < timer0Phase || at >= timer0 + timer0Cost ? 0 : timer0 + timer0Cost - at;
+    cycles += entryCost;
+    uint32_t start = cycles;
+    for (uint8_t i = 0; i < JUN_FADER_CHANNELS; i++) {
+        if (!active[i]) {
+            cycles += idleCost;
+            continue;
+        }
+        cycles += positionCost + levelCost[curve[i]] + checkCost;
+        for (size_t w = first; w < writes.size(); w++) {
+            if (writes[w].pin == junFaderChannels[i].pin) {
+                writes[w].offset = cycles + writeLands;
+                cycles += writeCost;
+            }
+        }
+    }
+    cycles += epilogueCost;
+    isrCycles += cycles - start + entryCost;
+    worstIsr = std::max(worstIsr, (uint64_t)(cycles - start + entryCost));
+}
+
+static void run(uint32_t ms) {
+    for (uint32_t i = 0; i < ms; i++) {
+        interrupt();
+    }
+}
+
+static uint8_t lastWrite(uint8_t pin) {
+    for (size_t w = writes.size(); w > 0; w--) {
+        if (writes[w - 1].pin == pin) return writes[w - 1].value;
+    }
+    return 0;
+}
+
+// Where a fade should be after t of ms, for from and to as PWM values
+static double ideal(uint8_t curve, double from, double to, double t, double ms) {
+    double x = std::min(t / ms, 1.0);
+    if (curve == JUN_FADER_EASED) {
+        x = x * x * (3 - 2 * x);
+    }
+    if (curve == JUN_FADER_GAMMA) {
+        double a = std::sqrt(from * 255), b = std::sqrt(to * 255);
+        double level = a + (b - a) * x;
+        return level * level / 255;
+    }
+    return from + (to - from) * x;
+}
+
+// Fades pin from where it is to target and follows it to the end
+static void follow(const char* name, uint8_t pin, uint8_t target, uint16_t ms, uint8_t curve, double tolerance) {
+    uint8_t from = lastWrite(pin);
+    writes.clear();
+    uint64_t begun = tick;
+    check(junFaderFadeTo(pin, target, ms, curve), "fadeTo found no channel");
+    uint32_t guard = 0;
+    while (junFaderIsFading(pin) && guard++ < 70000) {
+        interrupt();
+    }
+    uint64_t took = tick - begun;
+    double worst = 0;
+    bool backwards = false;
+    uint8_t previous = from;
+    for (const Write& w : writes) {
+        worst = std::max(worst, std::fabs(w.value - ideal(curve, from, target, w.tick - begun, ms)));
+        backwards |= target > from ? w.value < previous : w.value > previous;
+        previous = w.value;
+    }
+    bool once = junFaderTakeCompleted(pin) && !junFaderTakeCompleted(pin);
+    printf("  %-7s %3u to %3u over %5ums: %zu writes, ended on %3u after %llu ticks, at most %.1f off the curve\n",
+           name, from, target, ms, writes.size(), lastWrite(pin), (unsigned long long)took, worst);
+    check(took == ms, "a fade didn't end on its ms-th tick");
+    check(lastWrite(pin) == target, "a fade didn't end on its target");
+    check(worst <= tolerance, "a fade strayed from its curve");
+    check(!backwards, "a fade stepped backwards");
+    check(once, "completed didn't fire exactly once");
+}
+
+static void curves() {
+    hostAnalogWrite = recordWrite;
+    junFaderSetLevel(6, 0);
+    follow("linear", 6, 255, 1000, JUN_FADER_LINEAR, 2);
+    follow("linear", 6, 0, 255, JUN_FADER_LINEAR, 2);
+    follow("eased", 6, 200, 2000, JUN_FADER_EASED, 2);
+    follow("eased", 6, 10, 500, JUN_FADER_EASED, 2);
+    // fadeEngine.jun's fades, then targets no gamma level maps to exactly
+    junFaderSetLevel(6, 255);
+    follow("gamma", 6, 0, 6375, JUN_FADER_GAMMA, 4);
+    follow("gamma", 6, 255, 6375, JUN_FADER_GAMMA, 4);
+    follow("gamma", 6, 254, 300, JUN_FADER_GAMMA, 4);
+    follow("gamma", 6, 3, 300, JUN_FADER_GAMMA, 4);
+    follow("gamma", 6, 254, 300, JUN_FADER_GAMMA, 4);
+    follow("gamma", 6, 255, 300, JUN_FADER_GAMMA, 4);
+
+    // Lengths that 1.0 doesn't divide into evenly, up to the longest
+    uint32_t off = 0;
+    for (uint16_t ms : { 3u, 7u, 999u, 6375u, 22001u, 40000u, 65535u }) {
+        uint64_t begun = tick;
+        junFaderFadeTo(6, ms & 1 ? 0 : 255, ms, JUN_FADER_LINEAR);
+        while (junFaderIsFading(6)) {
+            interrupt();
+        }
+        off += tick - begun != ms;
+        junFaderTakeCompleted(6);
+    }
+    printf("  fades of 3ms to 65535ms: %u not ending on their ms-th tick\n", off);
+    check(off == 0, "a long fade didn't end on its ms-th tick");
+}
+
+static void channels() {
+    writes.clear();
+    // setLevel is where the next fade starts
+    junFaderSetLevel(5, 200);
+    junFaderFadeTo(5, 0, 1000, JUN_FADER_LINEAR);
+    run(1);
+    check(lastWrite(5) >= 199, "a fade after setLevel didn't start from its level");
+    // A new fade on a pin carries on from where the old one got to
+    run(499);
+    uint8_t half = lastWrite(5);
+    junFaderFadeTo(5, 255, 1000, JUN_FADER_LINEAR);
+    run(1);
+    check(std::abs(lastWrite(5) - half) <= 1, "a replaced fade jumped");
+
+    // Six pins fading, a seventh waits for one to finish and be collected
+    static const uint8_t pins[] = { 3, 5, 6, 9, 10, 11 };
+    for (uint8_t p : pins) {
+        junFaderFadeTo(p, 128, 100, JUN_FADER_LINEAR);
+    }
+    check(!junFaderFadeTo(2, 128, 100, JUN_FADER_LINEAR), "a seventh fade took a busy channel");
+    run(100);
+    check(!junFaderFadeTo(2, 128, 100, JUN_FADER_LINEAR), "a fade took a channel whose completion wasn't collected");
+    junFaderTakeCompleted(3);
+    check(junFaderFadeTo(2, 128, 100, JUN_FADER_LINEAR), "a fade couldn't take a collected channel");
+    run(100);
+    for (uint8_t p : { 2, 5, 6, 9, 10, 11 }) {
+        junFaderTakeCompleted(p);
+    }
+    printf("  setLevel, replaced fades and the seventh pin: checked\n");
+}
+
+// Interrupt share and how far each pin's writes wander within the tick
+static void occupancy(const char* name, const std::vector<uint8_t>& pins, uint8_t curve, uint16_t ms) {
+    for (size_t i = 0; i < pins.size(); i++) {
+        junFaderSetLevel(pins[i], i & 1 ? 0 : 255);
+    }
+    writes.clear();
+    isrCycles = worstIsr = 0;
+    uint64_t begun = tick;
+    for (size_t i = 0; i < pins.size(); i++) {
+        junFaderFadeTo(pins[i], i & 1 ? 255 : 0, ms, curve);
+    }
+    run(ms);
+    double share = 100.0 * isrCycles / ((tick - begun) * tickCycles);
+    uint32_t jitter = 0;
+    for (uint8_t p : pins) {
+        uint32_t low = UINT32_MAX, high = 0;
+        for (const Write& w : writes) {
+            if (w.pin == p) {
+                low = std::min(low, w.offset);
+                high = std::max(high, w.offset);
+            }
+        }
+        jitter = std::max(jitter, high - low);
+        junFaderTakeCompleted(p);
+    }
+    printf("  %s: interrupt %.2f%% of the CPU, longest %.0fus; writes move up to %.1fus within the tick "
+           "(estimated)\n", name, share, worstIsr * 1e6 / F_CPU, jitter * 1e6 / F_CPU);
+    check(share < 10, "the interrupt takes more than 10% of the CPU");
+}
+
+int main() {
+    printf("curves\n");
+    curves();
+    printf("channels\n");
+    channels();
+    printf("cpu and jitter\n");
+    occupancy("fadeEngine.jun, 2 gamma fades", { 6, 5 }, JUN_FADER_GAMMA, 6375);
+    occupancy("6 eased fades", { 3, 5, 6, 9, 10, 11 }, JUN_FADER_EASED, 2000);
+    printf("  fade.jun waits out all 6.4s of each fade itself, 100%% of the CPU; every value lands on a 1ms "
+           "tick, so up to 1ms after the curve reaches it\n");
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+// Runs lib/FastIo.jun's register access on the PC against an emulated
+// ATmega328P register file, where writing a 1 to a PINx bit flips that PORTx
+// bit and reading PINx gives outputs as driven and inputs as the outside
+// world has them. Checks that FastIo:pin finds the right registers for every
+// Uno pin, that each write changes only its own pin, that toggle flips its pin
+// with one write and no read-modify-write, and that isHigh reads both
+// directions right. For digWriteMask and digReadMask, checks that each port
+// the pins are on is read and written once and no other port is touched.
+// Then counts register accesses and cycles for a toggle and for an RGB frame
+// against the Arduino core's digitalWrite.
+#include "avrHost.h"
+
+// Reads and writes of each register, and the level outside each pin of
+// ports B, C and D for pins set as inputs
+static uint32_t reads[0x100], writes[0x100];
+static uint8_t outside[0x100];
+
+static bool isPin(uint16_t address) {
+    return address == 0x23 || address == 0x26 || address == 0x29;
+}
+
+struct HostRegister {
+    uint16_t address;
+
+    operator uint8_t() const {
+        reads[address]++;
+        if (isPin(address)) {
+            uint8_t ddr = hostIo[address + 1], port = hostIo[address + 2];
+            hostIo[address] = (port & ddr) | (outside[address] & ~ddr);
+        }
+        return hostIo[address];
+    }
+    HostRegister& operator=(uint8_t value) {
+        writes[address]++;
+        if (isPin(address)) {
+            hostIo[address + 2] ^= value;
+        } else {
+            hostIo[address] = value;
+        }
+        return *this;
+    }
+    HostRegister& operator|=(uint8_t value) {
+        return *this = (uint8_t)(*this | value);
+    }
+    HostRegister& operator&=(uint8_t value) {
+        return *this = (uint8_t)(*this & value);
+    }
+};
+
+#define JUN_FASTIO_REG(address) (HostRegister{ (uint16_t)(address) })
+
+#include "FastIo.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+static void clearCounts() {
+    memset(reads, 0, sizeof(reads));
+    memset(writes, 0, sizeof(writes));
+}
+
+struct FastPin {
+    uint16_t output, input;
+    uint8_t mask;
+};
+
+// What FastIo:pin returns
+static FastPin pin(uint16_t p) {
+    FastPin f;
+    junFastIoPin(p, f.output, f.input, f.mask);
+    return f;
+}
+
+static void registers() {
+    // PORTD, PORTB, PORTC and the PINx just below each
+    for (uint16_t p = 0; p < 20; p++) {
+        FastPin f = pin(p);
+        uint16_t port = p < 8 ? 0x2B : p < 14 ? 0x25 : 0x28;
+        uint8_t bit = p < 8 ? p : p < 14 ? p - 8 : p - 14;
+        check(f.output == port && f.input == port - 2 && f.mask == 1 << bit, "wrong registers for a pin");
+    }
+    printf("  pins 0-19 map to PORTD/PORTB/PORTC and PIND/PINB/PINC\n");
+}
+
+static void writeChecks() {
+    srand(6);
+    uint32_t wrong = 0, accesses = 0, calls = 0;
+    for (int n = 0; n < 100000; n++) {
+        uint16_t p = rand() % 20;
+        FastPin f = pin(p);
+        uint8_t before = rand();
+        hostIo[f.output] = before;
+        hostIo[f.output - 1] = 0xFF;
+        clearCounts();
+        uint8_t expect;
+        switch (rand() % 3) {
+            case 0:
+                junFastIoSetHigh(f.output, f.mask);
+                expect = before | f.mask;
+                break;
+            case 1:
+                junFastIoSetLow(f.output, f.mask);
+                expect = before & ~f.mask;
+                break;
+            default:
+                junFastIoToggle(f.input, f.mask);
+                expect = before ^ f.mask;
+                // One write to PINx, nothing else
+                if (reads[f.output] + writes[f.output] + reads[f.input] != 0 || writes[f.input] != 1) {
+                    wrong++;
+                }
+                break;
+        }
+        accesses += reads[f.output] + writes[f.output] + reads[f.input] + writes[f.input];
+        calls++;
+        if (hostIo[f.output] != expect) {
+            wrong++;
+        }
+    }
+    printf("  100000 random setHigh/setLow/toggle calls: %u wrong, %.2f register accesses each\n", wrong,
+           (double)accesses / calls);
+    check(wrong == 0, "a write changed the wrong bits or toggle did a read-modify-write");
+
+    // An interrupt that changes another pin on the port between a toggle's
+    // writes isn't undone, as there's nothing read back
+    FastPin led = pin(13), other = pin(12);
+    hostIo[led.output] = 0;
+    junFastIoToggle(led.input, led.mask);
+    junFastIoSetHigh(other.output, other.mask);
+    junFastIoToggle(led.input, led.mask);
+    check(hostIo[led.output] == other.mask, "toggle undid another pin's change");
+}
+
+static void readsBack() {
+    // Pins 8-11 outputs, 12-13 inputs; the outside pulls 12 high and 13 low
+    DDRB = 0x0F;
+    PORTB = 0x05;
+    outside[0x23] = 0x10;
+    bool ok = true;
+    for (uint16_t p = 8; p < 14; p++) {
+        FastPin f = pin(p);
+        bool expect = p < 12 ? (0x05 >> (p - 8)) & 1 : p == 12;
+        ok = ok && junFastIoIsHigh(f.input, f.mask) == expect;
+    }
+    printf("  isHigh on outputs and inputs: %s\n", ok ? "right" : "wrong");
+    check(ok, "isHigh read the wrong level");
+}
+
+// The Arduino core's digitalWrite, from wiring_digital.c. digitalPinToTimer,
+// digitalPinToBitMask, digitalPinToPort and portOutputRegister each read a
+// PROGMEM table, and a PWM pin also gets turnOffPWM, which pin 13 doesn't
+// need.
+static uint32_t flashReads = 0;
+
+static void coreDigitalWrite(uint8_t p, uint8_t value) {
+    flashReads += 4;
+    uint8_t bit = digitalPinToBitMask(p);
+    uint8_t port = digitalPinToPort(p);
+    if (port == NOT_A_PORT) {
+        return;
+    }
+    uint16_t out = (uint16_t)(uintptr_t)portOutputRegister(port);
+    uint8_t oldSREG = SREG;
+    cli();
+    if (value) {
+        JUN_FASTIO_REG(out) |= bit;
+    } else {
+        JUN_FASTIO_REG(out) &= ~bit;
+    }
+    SREG = oldSREG;
+}
+
+static void toggleCost() {
+    FastPin led = pin(13);
+    clearCounts();
+    flashReads = 0;
+    coreDigitalWrite(13, 1);
+    coreDigitalWrite(13, 0);
+    uint32_t core = reads[led.output] + writes[led.output];
+    uint32_t coreFlash = flashReads;
+    clearCounts();
+    junFastIoSetHigh(led.output, led.mask);
+    junFastIoSetLow(led.output, led.mask);
+    uint32_t fast = reads[led.output] + writes[led.output];
+    clearCounts();
+    junFastIoToggle(led.input, led.mask);
+    junFastIoToggle(led.input, led.mask);
+    uint32_t toggle = reads[led.input] + writes[led.input] + reads[led.output] + writes[led.output];
+    printf("  register accesses per on/off pair: digitalWrite %u (and %u table reads from flash), "
+           "FastIo:digWrite %u, FastIo:toggle %u\n", core, coreFlash, fast, toggle);
+    check(fast == 4 && toggle == 2, "more register accesses than a read-modify-write per write");
+
+    // Cycles per write (estimated from the instruction timings): digitalWrite
+    // 4 lpm table reads at 3 cycles, the NOT_A_PIN and timer tests, the
+    // register lookup, SREG save, cli, ld/or/st and restore, call and return,
+    // ~60; FastIo:digWrite with the pin record in registers: in, cli, ld, or,
+    // st, out and the high/low test, ~10; toggle a single st, ~2. Loop
+    // overhead not counted.
+    const double core1 = 60, fast1 = 10, toggle1 = 2;
+    printf("  estimated cycles per write: digitalWrite ~%.0f, FastIo:digWrite ~%.0f, FastIo:toggle ~%.0f; "
+           "toggle rates at 16MHz about %.0fkHz, %.0fkHz and %.0fkHz\n", core1, fast1, toggle1,
+           16000 / core1 / 2, 16000 / fast1 / 2, 16000 / toggle1 / 2);
+}
+
+// Random sets of pins in random order, some of them not pins at all
+static void batches() {
+    srand(7);
+    uint32_t wrong = 0, stray = 0, sets = 20000;
+    static const uint16_t ports[3] = { 0x25, 0x28, 0x2B };
+    for (uint32_t n = 0; n < sets; n++) {
+        uint16_t pins[24];
+        uint32_t length = 0;
+        bool taken[24] = {};
+        for (int i = rand() % 13; i > 0; i--) {
+            uint16_t p = rand() % 24;
+            if (!taken[p]) {
+                taken[p] = true;
+                pins[length++] = p;
+            }
+        }
+        uint32_t bits = rand();
+        uint8_t before[3];
+        for (int i = 0; i < 3; i++) {
+            hostIo[ports[i]] = before[i] = rand();
+            hostIo[ports[i] - 1] = rand();
+            outside[ports[i] - 2] = rand();
+        }
+        // What the ports should hold, and which of them the pins are on
+        uint8_t expect[3] = { before[0], before[1], before[2] };
+        bool used[3] = {};
+        for (uint32_t i = 0; i < length; i++) {
+            if (pins[i] >= 20) {
+                continue;
+            }
+            int port = pins[i] < 8 ? 2 : pins[i] < 14 ? 0 : 1;
+            used[port] = true;
+            uint8_t mask = digitalPinToBitMask(pins[i]);
+            expect[port] = bits >> i & 1 ? expect[port] | mask : expect[port] & ~mask;
+        }
+
+        clearCounts();
+        junFastIoWriteMask(pins, length, bits);
+        for (int i = 0; i < 3; i++) {
+            wrong += hostIo[ports[i]] != expect[i];
+            stray += used[i] ? reads[ports[i]] != 1 || writes[ports[i]] != 1 : reads[ports[i]] + writes[ports[i]] != 0;
+        }
+
+        clearCounts();
+        uint32_t read = junFastIoReadMask(pins, length);
+        for (uint32_t i = 0; i < length; i++) {
+            bool high = false;
+            if (pins[i] < 20) {
+                FastPin f = pin(pins[i]);
+                uint8_t ddr = hostIo[f.input + 1];
+                high = ((hostIo[f.output] & ddr) | (outside[f.input] & ~ddr)) & f.mask;
+            }
+            wrong += (read >> i & 1) != high;
+        }
+        for (int i = 0; i < 3; i++) {
+            stray += reads[ports[i] - 2] != (used[i] ? 1u : 0u) || writes[ports[i] - 2] != 0;
+        }
+    }
+    printf("  %u random pin sets through digWriteMask and digReadMask: %u wrong, %u with ports touched more or "
+           "less than once\n", sets, wrong, stray);
+    check(wrong == 0, "wrong pins written or read");
+    check(stray == 0, "a port was accessed more than once, or when no pin was on it");
+}
+
+// The portBatch.jun frame: pins 6, 5 and 3, all on PORTD
+static void frameCost() {
+    static const uint16_t rgb[3] = { 6, 5, 3 };
+    clearCounts();
+    for (int i = 0; i < 3; i++) {
+        coreDigitalWrite(rgb[i], 1);
+    }
+    uint32_t coreWrites = writes[0x2B], coreReads = reads[0x2B];
+    clearCounts();
+    junFastIoWriteMask(rgb, 3, 7);
+    printf("  RGB frame: digitalWrite x3 reads PORTD %u times and writes it %u times, so the pins change at %u "
+           "moments; digWriteMask %u and %u\n", coreReads, coreWrites, coreWrites, reads[0x2B], writes[0x2B]);
+    check(writes[0x2B] == 1, "digWriteMask wrote PORTD more than once");
+
+    // Estimated cycles: per pin in digWriteMask, 2 lpm table reads and the
+    // mask updates, ~25; per port slot checked, ~5; the write with SREG
+    // saved and cli, ~12
+    const uint32_t perPin = 25, perPort = 5, write = 12;
+    printf("  estimated cycles per frame: digitalWrite x3 ~%u, digWriteMask ~%u (%u pins, %u port slots)\n",
+           3 * 60, 3 * perPin + JUN_FASTIO_PORTS * perPort + write, 3, JUN_FASTIO_PORTS);
+}
+
+int main() {
+    printf("registers\n");
+    registers();
+    printf("writes\n");
+    writeChecks();
+    readsBack();
+    printf("batches\n");
+    batches();
+    printf("cost\n");
+    toggleCost();
+    frameCost();
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,439 @@
+// Runs lib/I2c.jun's TWI interrupt on the PC against a model of the
+// ATmega328P TWI master and a bus with simulated devices: a register device
+// like the MPU-6050, one that refuses the second data byte of a write, one
+// that stretches the clock and addresses nobody answers. Checks that every
+// request gets the result the devices give, in order, with one start and
+// one stop each and no bytes when it failed, that a full queue refuses requests and that losing
+// arbitration fails only the request it happened to. Then times
+// i2cSensor.jun's reads at 100kHz and 400kHz: bus time, the interrupt's
+// CPU time, how long loop() is held up against Wire, and throughput with
+// the queue kept full.
+#include "avrHost.h"
+
+#include <initializer_list>
+#include <vector>
+
+#include "I2c.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Times are hand counted estimates: the interrupt ~45 to respond and save
+// registers, ~25 for the switch and its case and ~40 to restore and return;
+// ~60 more when it finishes a request and starts the next. Submitting a
+// request ~70 plus ~5 a byte, taking a result ~50 plus ~5 a byte.
+static const uint32_t isrEntry = 45, isrBody = 25, isrExit = 40, finishCost = 60;
+static const uint32_t submitCost = 70, takeCost = 50, byteCost = 5;
+
+// A device on the bus. Writes set the register pointer with the first byte
+// and store the rest from there on; reads go on from the pointer.
+struct Device {
+    uint8_t address;
+    // Data bytes a write takes before it's NACKed, and clock stretching in
+    // cycles per byte
+    uint32_t accepts;
+    uint32_t stretch;
+    uint8_t regs[256];
+    uint8_t pointer;
+    uint32_t taken;
+
+    bool write(uint8_t b) {
+        if (taken >= accepts) return false;
+        if (taken++ == 0) {
+            pointer = b;
+        } else {
+            regs[pointer++] = b;
+        }
+        return true;
+    }
+    uint8_t read() { return regs[pointer++]; }
+};
+
+static std::vector<Device> devices;
+
+static Device* find(std::vector<Device>& on, uint8_t address) {
+    for (Device& d : on) {
+        if (d.address == address) return &d;
+    }
+    return nullptr;
+}
+
+// The TWI
+enum Op { None, Start, Stop, StopStart, Send, Receive };
+enum Phase { Idle, Started, Writing, Reading, NotAcked, Lost };
+static Op op = None;
+static Phase phase = Idle;
+static uint64_t cycle = 0, opDone = 0, otherMaster = 0;
+static uint32_t bitCycles = 40;
+static bool flag = false, owned = false, receiveAck = false, inIsr = false, stealNext = false;
+static Device* target = nullptr;
+static uint32_t starts = 0, repeated = 0, stops = 0, overlapped = 0, stuckFlag = 0;
+static uint64_t isrCycles = 0, isrCount = 0;
+
+static void schedule(Op next, uint64_t cycles) {
+    overlapped += op != None;
+    op = next;
+    opDone = cycle + cycles;
+}
+
+// What the TWI does with a write to TWCR: writing TWINT clears the flag and
+// starts whatever TWSTA, TWSTO and the state ask for
+static void twcrWritten() {
+    uint8_t v = TWCR.value;
+    if (!(v & (1 << TWINT))) {
+        return;
+    }
+    TWCR.value = v & ~(1 << TWINT);
+    flag = false;
+    bool sta = v & (1 << TWSTA), sto = v & (1 << TWSTO);
+    if (sta && sto) {
+        schedule(StopStart, 2 * bitCycles);
+    } else if (sta) {
+        // A start waits for another master to let go of the bus
+        uint64_t free = owned ? cycle : std::max(cycle, otherMaster);
+        schedule(Start, free - cycle + bitCycles);
+    } else if (sto) {
+        schedule(Stop, bitCycles);
+    } else if (phase == Started || phase == Writing) {
+        schedule(Send, 9 * bitCycles + (phase == Writing && target ? target->stretch : 0));
+    } else if (phase == Reading) {
+        receiveAck = v & (1 << TWEA);
+        schedule(Receive, 9 * bitCycles + target->stretch);
+    }
+}
+
+static void raise(uint8_t status) {
+    TWSR = status;
+    TWCR.value |= 1 << TWINT;
+    flag = true;
+}
+
+static void complete() {
+    Op done = op;
+    op = None;
+    switch (done) {
+        case None:
+            break;
+        case Stop:
+        case StopStart:
+            stops++;
+            owned = false;
+            phase = Idle;
+            TWCR.value &= ~(1 << TWSTO);
+            if (done == Stop) break;
+            // fall through
+        case Start:
+            starts += !owned;
+            repeated += owned;
+            raise(owned ? 0x10 : 0x08);
+            owned = true;
+            phase = Started;
+            break;
+        case Send:
+            if (phase == Started) {
+                bool reading = TWDR & 1;
+                if (stealNext) {
+                    // Another master wins the address and keeps the bus a while
+                    stealNext = false;
+                    owned = false;
+                    phase = Lost;
+                    otherMaster = cycle + 30 * bitCycles;
+                    raise(0x38);
+                    break;
+                }
+                target = find(devices, TWDR >> 1);
+                if (target) {
+                    target->taken = 0;
+                }
+                phase = !target ? NotAcked : reading ? Reading : Writing;
+                raise(reading ? (target ? 0x40 : 0x48) : (target ? 0x18 : 0x20));
+            } else {
+                bool ack = target->write(TWDR);
+                phase = ack ? Writing : NotAcked;
+                raise(ack ? 0x28 : 0x30);
+            }
+            break;
+        case Receive:
+            TWDR = target->read();
+            phase = receiveAck ? Reading : NotAcked;
+            raise(receiveAck ? 0x50 : 0x58);
+            break;
+    }
+}
+
+static void runIsr() {
+    uint64_t begun = cycle;
+    uint8_t run = junI2cRun;
+    cycle += isrEntry + isrBody;
+    inIsr = true;
+    TWI_vect_host();
+    inIsr = false;
+    cycle += (junI2cRun != run ? finishCost : 0) + isrExit;
+    stuckFlag += flag;
+    isrCycles += cycle - begun;
+    isrCount++;
+}
+
+// Moves the clock on, running the TWI and its interrupt meanwhile
+static void spend(uint64_t cycles) {
+    uint64_t until = cycle + cycles;
+    while (op != None && opDone <= until) {
+        cycle = std::max(cycle, opDone);
+        complete();
+        if (flag && (TWCR.value & (1 << TWIE)) && !inIsr) {
+            runIsr();
+        }
+    }
+    cycle = std::max(cycle, until);
+}
+
+// Reads of TWCR only come from junI2cSubmit waiting out a stop
+static uint64_t spun = 0;
+static void twcrRead() {
+    spend(3);
+    spun += 3;
+}
+
+static void begin(uint32_t hz) {
+    op = None;
+    phase = Idle;
+    flag = owned = stealNext = false;
+    otherMaster = 0;
+    TWCR.value = 0;
+    junI2cBegin(hz);
+    bitCycles = 16 + 2 * TWBR;
+}
+
+// The requests as the Juniper functions make them
+struct Request {
+    uint8_t tag, address;
+    std::vector<uint8_t> write;
+    uint8_t read;
+};
+
+static bool submit(const Request& r) {
+    spend(submitCost + byteCost * r.write.size());
+    return junI2cSubmit(r.tag, r.address, r.write.data(), r.write.size(), r.read);
+}
+
+struct Result {
+    uint8_t tag;
+    bool ok;
+    std::vector<uint8_t> data;
+    bool operator==(const Result& o) const { return tag == o.tag && ok == o.ok && data == o.data; }
+};
+
+static bool take(Result& out) {
+    uint8_t data[8], length = 0;
+    spend(takeCost);
+    if (!junI2cTake(out.tag, out.ok, data, length)) {
+        return false;
+    }
+    spend(byteCost * length);
+    out.data.assign(data, data + length);
+    return true;
+}
+
+// What the devices should answer, worked out on copies of them
+static std::vector<Device> reference;
+
+static Result expect(const Request& r) {
+    Result e = { r.tag, false, {} };
+    Device* d = find(reference, r.address);
+    if (!d) return e;
+    d->taken = 0;
+    for (uint8_t b : r.write) {
+        if (!d->write(b)) return e;
+    }
+    for (uint8_t i = 0; i < r.read; i++) {
+        e.data.push_back(d->read());
+    }
+    e.ok = true;
+    return e;
+}
+
+static void addDevices() {
+    devices.clear();
+    Device mpu = { 0x68, UINT32_MAX, 0, {}, 0, 0 };
+    Device picky = { 0x20, 1, 0, {}, 0, 0 };
+    Device slow = { 0x50, UINT32_MAX, 50 * 16, {}, 0, 0 };
+    for (int i = 0; i < 256; i++) {
+        mpu.regs[i] = i * 7 + 3;
+        picky.regs[i] = 255 - i;
+        slow.regs[i] = i ^ 0x5A;
+    }
+    devices = { mpu, picky, slow };
+    reference = devices;
+}
+
+static Request randomRequest(uint8_t tag) {
+    static const uint8_t addresses[] = { 0x68, 0x68, 0x68, 0x20, 0x50, 0x3C };
+    Request r = { tag, addresses[rand() % 6], {}, 0 };
+    switch (rand() % 4) {
+        case 0: // write
+            for (int n = 1 + rand() % 8; n > 0; n--) r.write.push_back(rand());
+            break;
+        case 1: // read
+            r.read = 1 + rand() % 8;
+            break;
+        case 2: // readRegisters
+            r.write.push_back(rand());
+            r.read = 1 + rand() % 8;
+            break;
+        default: // writeRegister
+            r.write = { (uint8_t)rand(), (uint8_t)rand() };
+            break;
+    }
+    return r;
+}
+
+static void requests() {
+    addDevices();
+    begin(400000);
+    srand(1);
+    spun = 0;
+    std::vector<Result> expected, got;
+    uint32_t refused = 0, submitted = 0;
+    for (uint32_t round = 0; submitted < 5000 && round < 100000; round++) {
+        // loop() submits a few and picks up what finished
+        for (int k = rand() % 4; k > 0 && submitted < 5000; k--) {
+            Request r = randomRequest(submitted);
+            if (submit(r)) {
+                expected.push_back(expect(r));
+                submitted++;
+            } else {
+                refused++;
+            }
+        }
+        spend(rand() % (400 * 16));
+        Result result;
+        while (take(result)) {
+            got.push_back(result);
+        }
+    }
+    for (uint32_t guard = 0; got.size() < expected.size() && guard < 100000; guard++) {
+        spend(16 * 10);
+        Result result;
+        while (take(result)) {
+            got.push_back(result);
+        }
+    }
+    spend(16 * 100);
+    uint32_t failed = 0;
+    for (const Result& e : expected) {
+        failed += !e.ok;
+    }
+    printf("  5000 random requests to 3 devices and a missing one: %zu results, %u failed as expected, %u "
+           "refused with the queue full; %u starts, %u repeated starts, %u stops, %.1fus waiting for stops in "
+           "submit\n", got.size(), failed, refused, starts, repeated, stops, spun / 16.0);
+    check(got == expected, "a result isn't what the devices answered, or came out of order");
+    check(starts == submitted && stops == submitted, "a request didn't get exactly one start and one stop");
+    check(overlapped == 0, "TWCR was written with the TWI still busy");
+    check(stuckFlag == 0, "the interrupt left TWINT set");
+    check(!junI2cBusy && !(TWCR.value & (1 << TWSTO)), "the bus wasn't left idle");
+}
+
+static void queueFull() {
+    addDevices();
+    begin(100000);
+    uint32_t taken = 0;
+    while (taken < 20 && submit({ (uint8_t)taken, 0x50, {}, 8 })) {
+        taken++;
+    }
+    Result r;
+    bool noneYet = !take(r);
+    spend(16 * 20000);
+    uint32_t results = 0;
+    while (take(r)) {
+        results++;
+    }
+    printf("  queue of %u: %u taken, %u results\n", JUN_I2C_QUEUE, taken, results);
+    check(taken == JUN_I2C_QUEUE, "the queue didn't take exactly JUN_I2C_QUEUE requests");
+    check(noneYet && results == taken, "results came out before they finished or went missing");
+}
+
+static void arbitration() {
+    addDevices();
+    begin(400000);
+    stops = 0;
+    stealNext = true;
+    submit({ 1, 0x68, { 0x3B }, 6 });
+    submit({ 2, 0x68, { 0x3B }, 6 });
+    spend(16 * 2000);
+    Result a, b;
+    bool both = take(a) && take(b);
+    printf("  arbitration lost on the first of two reads: %s, then %s\n", a.ok ? "ok" : "failed",
+           b.ok ? "ok" : "failed");
+    check(both && !a.ok && b.ok && b.data.size() == 6 && b.data[0] == (uint8_t)(0x3B * 7 + 3),
+          "losing arbitration didn't fail just the request it happened to");
+    check(stops == 1, "a stop was sent on a bus another master held");
+}
+
+// i2cSensor.jun: readRegisters(0x68, 0x3B, 6) ten times a second, and the
+// queue kept full of them
+static void timing(uint32_t hz) {
+    addDevices();
+    begin(hz);
+    // One read on its own: bus time, interrupts, and loop() time
+    isrCycles = isrCount = 0;
+    uint64_t begun = cycle;
+    submit({ 1, 0x68, { 0x3B }, 6 });
+    uint64_t submitted = cycle;
+    Result r;
+    for (uint32_t guard = 0; !take(r) && guard < 10000; guard++) {
+        spend(16 * 5);
+    }
+    uint64_t bus = cycle - begun;
+    double loopUs = (submitted - begun + takeCost + 6 * byteCost) / 16.0;
+    // Wire holds loop() for the transfer and its own ~30us of set up
+    double wireUs = bus / 16.0 + 30;
+    printf("  %3ukHz, one 6 byte register read: %.0fus on the bus, %llu interrupts taking %.0fus, loop() busy "
+           "%.1fus (Wire: ~%.0fus)\n", hz / 1000, bus / 16.0, (unsigned long long)isrCount, isrCycles / 16.0,
+           loopUs, wireUs);
+    check(r.ok && r.data.size() == 6, "i2cSensor.jun's read failed");
+
+    // The queue kept full for a second
+    isrCycles = isrCount = 0;
+    begun = cycle;
+    uint32_t done = 0;
+    uint64_t worstLatency = 0, totalLatency = 0;
+    std::vector<uint64_t> sentAt(256);
+    uint8_t tag = 0;
+    while (cycle < begun + F_CPU) {
+        while (submit({ tag, 0x68, { 0x3B }, 6 })) {
+            sentAt[tag++] = cycle;
+        }
+        spend(16 * 20);
+        while (take(r)) {
+            uint64_t latency = cycle - sentAt[r.tag];
+            worstLatency = std::max(worstLatency, latency);
+            totalLatency += latency;
+            done++;
+        }
+    }
+    double seconds = (double)(cycle - begun) / F_CPU;
+    printf("         queue kept full: %.0f reads/s (%.0f bytes/s), interrupts %.1f%% of the CPU, a read waits "
+           "%.0fus on average in the queue of %u\n", done / seconds, 6 * done / seconds,
+           100.0 * isrCycles / (cycle - begun), totalLatency / 16.0 / done, JUN_I2C_QUEUE);
+    check(done > 0, "no reads finished");
+}
+
+int main() {
+    hostTwcrWritten = twcrWritten;
+    hostTwcrRead = twcrRead;
+    printf("requests\n");
+    requests();
+    queueFull();
+    arbitration();
+    printf("timing (estimated)\n");
+    timing(100000);
+    timing(400000);
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// A model of the ATmega328P pin change interrupt as the sims drive it: the
+// PCINT flag, the Arduino core's timer0 overflow interrupt that micros()
+// relies on, the priority between them and the time each takes. The sims
+// give it the times a port changes and it calls the module's interrupt code
+// at the cycle the port would be read, with the port and timer0 registers
+// set as they would be then.
+//
+// There's no AVR compiler here, so interrupt times are estimates counted by
+// hand from the AVR instruction timings for what avr-gcc -Os makes of the
+// code. They are written out where each sim defines its PinChangeCost.
+#pragma once
+
+#include "avrHost.h"
+
+#include <algorithm>
+#include <vector>
+
+// Cycles from the interrupt flag being set to the port read, and to the
+// reti. Both count 4 cycles to respond, 3 for the jmp in the vector table
+// and ~2 to finish the instruction loop() was on.
+struct PinChangeCost {
+    const char* name;
+    uint32_t read;
+    uint32_t total;
+};
+
+// The core's TIMER0_OVF_vect: prologue, timer0_millis and timer0_fract
+// update, overflow count, epilogue
+static const uint32_t timer0Cost = 110;
+static const uint32_t timer0Period = 64 * 256;
+
+// Runs pin change interrupts for a port that changes at each of edges (in
+// cycles, sorted), from cycle start until the flags go quiet after the last
+// edge. read(n, cycle) is called at each port read with the number of edges
+// so far and must set the port and call the service routine. between() runs
+// after each interrupt, standing in for loop().
+template<typename Read, typename Between>
+static void runPinChange(const PinChangeCost& cost, const std::vector<uint64_t>& edges, uint64_t start, Read read,
+                         Between between) {
+    auto edgesBy = [&](uint64_t t) -> size_t {
+        return std::upper_bound(edges.begin(), edges.end(), t) - edges.begin();
+    };
+    uint64_t overflowsServiced = start / timer0Period;
+    timer0_overflow_count = overflowsServiced;
+    uint64_t cpu = start;
+    uint64_t cleared = start - 1;
+    uint64_t end = (edges.empty() ? start : edges.back()) + 2 * timer0Period;
+    while (true) {
+        // The pin change flag is set by the first edge after it was last
+        // cleared, the timer0 flag by the next overflow
+        size_t pending = edgesBy(cleared);
+        uint64_t pinFlag = pending < edges.size() ? edges[pending] : UINT64_MAX;
+        uint64_t timerFlag = (overflowsServiced + 1) * timer0Period;
+        if (pinFlag == UINT64_MAX && timerFlag > end) {
+            break;
+        }
+        // PCINT has priority over TIMER0_OVF when both are waiting
+        uint64_t pinTaken = pinFlag > cpu ? pinFlag : cpu;
+        uint64_t timerTaken = timerFlag > cpu ? timerFlag : cpu;
+        if (pinTaken <= timerTaken) {
+            uint64_t at = pinTaken + cost.read;
+            TCNT0 = (at / 64) & 255;
+            TIFR0 = at / timer0Period > overflowsServiced ? 1 << TOV0 : 0;
+            timer0_overflow_count = overflowsServiced;
+            read(edgesBy(at), at);
+            // The interrupt clears the flag just before the read
+            cleared = at;
+            // One instruction of loop() runs before the next interrupt
+            cpu = pinTaken + cost.total + 1;
+            between();
+        } else {
+            overflowsServiced++;
+            cpu = timerTaken + timer0Cost + 1;
+        }
+    }
+}
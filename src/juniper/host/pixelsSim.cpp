@@ -0,0 +1,376 @@
+// Runs lib/Pixels.jun's show on the PC. The send loop's inline assembly is
+// run by a small AVR interpreter that counts cycles the way the ATmega328P
+// does, and the pin it drives is decoded back into bits the way a WS2812
+// reads them, from the length of each high pulse. Checks that:
+//   - pixels come out in green, red, blue order
+//   - every high pulse is inside the WS2812 0 and 1 windows
+//   - brightness scaling is within one step of exact for every value/level
+//   - with dither on, 8 frames average to the unrounded scaled value
+//   - unchanged frames are skipped and changed ones are not
+//   - other pins on the port are left alone
+// Prints the bit timing it measured and exits with 1 if any check fails.
+#include "avrHost.h"
+
+#include <string>
+#include <vector>
+
+struct Rgb {
+    uint8_t r, g, b;
+};
+
+// Pin changes seen by the interpreter, in CPU cycles since the frame began
+struct Edge {
+    uint64_t cycle;
+    bool high;
+};
+
+static std::vector<Edge> edges;
+static uint8_t pixelMask = 1 << 6;
+static uint8_t otherPins = 0x85;
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    // A bad send loop fails on every bit; the first few are enough
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// The operands junPixelsSend's asm names, and the Z flag
+struct Machine {
+    const uint8_t*& data;
+    uint16_t& count;
+    uint8_t& byte;
+    uint8_t& bit;
+    uint8_t hi, lo;
+    volatile uint8_t* port;
+    bool zero = false;
+    uint64_t cycle = 0;
+
+    uint8_t& reg(const std::string& name) {
+        if (name == "%[byte]") return byte;
+        if (name == "%[bit]") return bit;
+        if (name == "%[hi]") return hi;
+        if (name == "%[lo]") return lo;
+        printf("unknown register %s\n", name.c_str());
+        exit(1);
+    }
+};
+
+struct Insn {
+    std::string op;
+    std::vector<std::string> args;
+    int label = -1;
+};
+
+// Runs the asm statement, given as its source text. Only the instructions it
+// uses are known; anything else stops the simulation rather than guessing at
+// its timing.
+static void hostPixelsAsm(const char* source, const uint8_t*& data, uint16_t& count, uint8_t& byte,
+                          uint8_t& bit, volatile uint8_t* port, uint8_t hi, uint8_t lo) {
+    // The instructions are the string literals before the first ':'
+    std::string text;
+    bool quoted = false;
+    for (const char* c = source; *c != 0 && (quoted || *c != ':'); c++) {
+        if (*c == '"') {
+            quoted = !quoted;
+        } else if (quoted && *c == '\\') {
+            c++;
+            text += *c == 'n' ? '\n' : *c == 't' ? '\t' : *c;
+        } else if (quoted) {
+            text += *c;
+        }
+    }
+    std::vector<Insn> program;
+    std::vector<std::pair<int, size_t>> labels;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        std::string line = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? text.size() : end + 1;
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty()) {
+            continue;
+        }
+        if (line.back() == ':') {
+            labels.push_back({ atoi(line.c_str()), program.size() });
+            continue;
+        }
+        Insn insn;
+        size_t space = line.find(' ');
+        insn.op = line.substr(0, space);
+        if (space != std::string::npos) {
+            std::string rest = line.substr(space);
+            size_t at = 0;
+            while (at < rest.size()) {
+                size_t comma = rest.find(',', at);
+                std::string arg = rest.substr(at, comma == std::string::npos ? std::string::npos : comma - at);
+                arg.erase(0, arg.find_first_not_of(' '));
+                insn.args.push_back(arg);
+                at = comma == std::string::npos ? rest.size() : comma + 1;
+            }
+        }
+        program.push_back(insn);
+    }
+    // Branches only go back ("2b"), to the nearest label of that number
+    for (size_t pc = 0; pc < program.size(); pc++) {
+        Insn& insn = program[pc];
+        if (insn.op == "brne") {
+            for (auto& l : labels) {
+                if (l.first == atoi(insn.args[0].c_str()) && l.second <= pc) {
+                    insn.label = l.second;
+                }
+            }
+        }
+    }
+
+    Machine m = { data, count, byte, bit, hi, lo, port };
+    bool level = (*port & pixelMask) != 0;
+    size_t pc = 0;
+    while (pc < program.size()) {
+        const Insn& insn = program[pc];
+        size_t next = pc + 1;
+        if (insn.op == "ld" && insn.args[1] == "%a[data]+") {
+            m.reg(insn.args[0]) = *m.data++;
+            m.cycle += 2;
+        } else if (insn.op == "ldi") {
+            m.reg(insn.args[0]) = atoi(insn.args[1].c_str());
+            m.cycle += 1;
+        } else if (insn.op == "st" && insn.args[0] == "%a[port]") {
+            uint8_t value = m.reg(insn.args[1]);
+            *m.port = value;
+            check((value & ~pixelMask) == otherPins, "another pin on the port changed");
+            // The store lands on the second cycle
+            if (((value & pixelMask) != 0) != level) {
+                level = !level;
+                edges.push_back({ m.cycle + 1, level });
+            }
+            m.cycle += 2;
+        } else if (insn.op == "nop") {
+            m.cycle += 1;
+        } else if (insn.op == "sbrs") {
+            // Skipping a one word instruction takes 2 cycles
+            if (m.reg(insn.args[0]) & (1 << atoi(insn.args[1].c_str()))) {
+                next = pc + 2;
+                m.cycle += 2;
+            } else {
+                m.cycle += 1;
+            }
+        } else if (insn.op == "lsl") {
+            m.reg(insn.args[0]) <<= 1;
+            m.cycle += 1;
+        } else if (insn.op == "dec") {
+            m.zero = --m.reg(insn.args[0]) == 0;
+            m.cycle += 1;
+        } else if (insn.op == "sbiw" && insn.args[0] == "%[count]") {
+            m.count -= atoi(insn.args[1].c_str());
+            m.zero = m.count == 0;
+            m.cycle += 2;
+        } else if (insn.op == "brne") {
+            if (!m.zero) {
+                next = insn.label;
+                m.cycle += 2;
+            } else {
+                m.cycle += 1;
+            }
+        } else {
+            printf("unsupported instruction %s\n", insn.op.c_str());
+            exit(1);
+        }
+        pc = next;
+    }
+    hostMicros += m.cycle / 16;
+}
+
+// junPixelsSend's asm statement becomes a call to the interpreter, with the
+// statement's text and the send loop's locals. volatile is only replaced
+// where a '(' follows it, which is just the asm statement.
+#define asm
+#define volatile(...) hostPixelsAsm(#__VA_ARGS__, data, count, byte, bit, port, hi, lo)
+#include "Pixels.inc"
+#undef volatile
+#undef asm
+
+static uint8_t port = 0;
+
+// Timing of one frame, in cycles
+struct Timing {
+    uint32_t zeroHigh[2] = { 1000, 0 };
+    uint32_t oneHigh[2] = { 1000, 0 };
+    uint32_t zeroBit = 0, oneBit = 0;
+    uint32_t longestLow = 0;
+    uint64_t total = 0;
+};
+
+static void widen(uint32_t range[2], uint32_t value) {
+    range[0] = value < range[0] ? value : range[0];
+    range[1] = value > range[1] ? value : range[1];
+}
+
+// Reads the bytes back off the pin, the way the LEDs do: a high pulse of
+// 250 to 550ns is a 0, 650 to 950ns a 1 (WS2812B datasheet, +-150ns). Low
+// times only have to stay under the reset time, taken here as 5us.
+static std::vector<uint8_t> decode(Timing& t) {
+    std::vector<uint8_t> bytes;
+    uint8_t byte = 0;
+    int bits = 0;
+    for (size_t i = 0; i + 1 < edges.size(); i += 2) {
+        check(edges[i].high && !edges[i + 1].high, "pin edges out of order");
+        uint32_t high = edges[i + 1].cycle - edges[i].cycle;
+        double ns = high * 62.5;
+        bool one = ns >= 650 && ns <= 950;
+        check(one || (ns >= 250 && ns <= 550), "high pulse outside both WS2812 windows");
+        if (i + 2 < edges.size()) {
+            uint32_t low = edges[i + 2].cycle - edges[i + 1].cycle;
+            t.longestLow = low > t.longestLow ? low : t.longestLow;
+            // Bit periods inside a byte; the last bit of a byte runs long
+            if (bits < 7) {
+                (one ? t.oneBit : t.zeroBit) = high + low;
+            }
+        }
+        widen(one ? t.oneHigh : t.zeroHigh, high);
+        byte = (byte << 1) | (one ? 1 : 0);
+        if (++bits == 8) {
+            bytes.push_back(byte);
+            byte = 0;
+            bits = 0;
+        }
+    }
+    check(bits == 0, "frame ended part way through a byte");
+    check(t.longestLow * 62.5 < 5000, "line low long enough to latch mid frame");
+    if (!edges.empty()) {
+        t.total = edges.back().cycle - edges.front().cycle;
+    }
+    return bytes;
+}
+
+// One call of Pixels:show. Returns whether a frame went out, and its bytes.
+static bool show(const std::vector<Rgb>& pixels, std::vector<uint8_t>& bytes, Timing& t) {
+    edges.clear();
+    hostMicros += 1000;
+    bool sent = junPixelsShow(pixels.data(), pixels.size());
+    check(sent == !edges.empty(), "show's result doesn't match the pin");
+    bytes = decode(t);
+    check((port & pixelMask) == 0, "line left high after the frame");
+    return sent;
+}
+
+static bool show(const std::vector<Rgb>& pixels, std::vector<uint8_t>& bytes) {
+    Timing t;
+    return show(pixels, bytes, t);
+}
+
+// What Pixels:setBrightness and Pixels:setDither do
+static void setBrightness(uint8_t level) {
+    if (junPixelsBrightness != level) {
+        junPixelsBrightness = level;
+        junPixelsDirty = true;
+    }
+}
+
+static void setDither(bool on) {
+    junPixelsDither = on;
+    junPixelsDirty = true;
+}
+
+int main() {
+    port = otherPins;
+    junPixelsPort = &port;
+    junPixelsMask = pixelMask;
+    std::vector<uint8_t> bytes;
+
+    printf("color order\n");
+    std::vector<Rgb> strip;
+    for (int i = 0; i < 8; i++) {
+        strip.push_back({ (uint8_t)(i * 30 + 1), (uint8_t)(255 - i * 30), (uint8_t)(i * 17 + 128) });
+    }
+    Timing t;
+    check(show(strip, bytes, t), "first frame skipped");
+    bool order = bytes.size() == strip.size() * 3;
+    for (size_t i = 0; order && i < strip.size(); i++) {
+        order = bytes[i * 3] == strip[i].g && bytes[i * 3 + 1] == strip[i].r && bytes[i * 3 + 2] == strip[i].b;
+    }
+    check(order, "bytes on the wire aren't green, red, blue");
+    printf("  %zu LEDs, %zu bytes decoded\n", strip.size(), bytes.size());
+
+    printf("bit timing\n");
+    printf("  1 bit: high %u-%u cycles, %u per bit\n", t.oneHigh[0], t.oneHigh[1], t.oneBit);
+    printf("  0 bit: high %u-%u cycles, %u per bit\n", t.zeroHigh[0], t.zeroHigh[1], t.zeroBit);
+    printf("  longest low %u cycles (%.2fus)\n", t.longestLow, t.longestLow / 16.0);
+    printf("  %.1fus per LED with interrupts off\n", t.total / 16.0 / strip.size());
+
+    printf("skipping\n");
+    check(!show(strip, bytes), "unchanged frame was sent");
+    strip[5].b ^= 1;
+    check(show(strip, bytes), "frame with one changed byte was skipped");
+    strip.pop_back();
+    check(show(strip, bytes) && bytes.size() == strip.size() * 3, "shorter frame not sent in full");
+    std::vector<Rgb> longStrip(JUN_PIXELS_MAX + 6, Rgb{ 1, 2, 3 });
+    check(show(longStrip, bytes) && bytes.size() == JUN_PIXELS_MAX * 3, "frame not cut to JUN_PIXELS_MAX");
+    printf("  sent %u, skipped %u\n", junPixelsSent, junPixelsSkipped);
+
+    printf("brightness\n");
+    // Every value at every level, straight through junPixelsPut
+    double worst = 0;
+    for (int level = 0; level < 256; level++) {
+        junPixelsBrightness = level;
+        for (int value = 0; value < 256; value++) {
+            bool fractional = false;
+            junPixelsPut(0, value, 0, fractional);
+            double error = junPixelsBytes[0] - value * level / 255.0;
+            worst = error < 0 ? (-error > worst ? -error : worst) : (error > worst ? error : worst);
+        }
+    }
+    printf("  worst error against value * level / 255: %.3f\n", worst);
+    check(worst < 1, "scaled value more than one step off");
+    // And a scaled frame on the wire
+    setBrightness(100);
+    std::vector<Rgb> dim = { { 255, 128, 3 }, { 10, 200, 77 } };
+    show(dim, bytes);
+    bool scaled = bytes.size() == 6;
+    for (size_t i = 0; scaled && i < dim.size(); i++) {
+        scaled = bytes[i * 3] == dim[i].g * 101 / 256 && bytes[i * 3 + 1] == dim[i].r * 101 / 256
+            && bytes[i * 3 + 2] == dim[i].b * 101 / 256;
+    }
+    check(scaled, "brightness 100 frame has the wrong bytes");
+
+    printf("dither\n");
+    // Over 8 frames each channel should average to value * (level + 1) / 256,
+    // the scaled value before rounding, within 1/8
+    setDither(true);
+    worst = 0;
+    for (int level = 0; level < 256; level += 3) {
+        setBrightness(level);
+        for (int value = 0; value < 256; value += 5) {
+            std::vector<Rgb> one = { { (uint8_t)value, (uint8_t)value, (uint8_t)value } };
+            uint32_t sum = 0;
+            int frames = 0;
+            for (int f = 0; f < 8; f++) {
+                if (show(one, bytes)) {
+                    frames++;
+                } else {
+                    // Skipped frames keep showing the last bytes
+                    bytes.assign(junPixelsBytes, junPixelsBytes + 3);
+                }
+                sum += bytes[0];
+            }
+            double exact = value * (level + 1) / 256.0;
+            double error = sum / 8.0 - exact;
+            error = error < 0 ? -error : error;
+            worst = error > worst ? error : worst;
+            bool fractional = (value * (level + 1)) % 256 != 0;
+            if (fractional) {
+                check(frames == 8, "dithered frame with a fraction was skipped");
+            }
+        }
+    }
+    printf("  worst error of the 8 frame average: %.3f\n", worst);
+    check(worst <= 0.125 + 1e-9, "dither average more than 1/8 off");
+    setBrightness(255);
+    std::vector<Rgb> full = { { 10, 20, 30 } };
+    show(full, bytes);
+    check(!show(full, bytes), "dither resent a frame with nothing to make up");
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
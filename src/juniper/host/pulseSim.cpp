@@ -0,0 +1,326 @@
+// Runs lib/Pulse.jun's input capture and overflow interrupts on the PC
+// against a model of Timer1 at 2 ticks per us: edges on pin 8 are latched
+// into ICR1 by the hardware, the interrupts run when they can, behind the
+// core's timer0 interrupt and loop()'s own moments with interrupts off.
+// Feeds it synthetic waveforms and checks that every width and period comes
+// out within a tick of the truth, also when an edge lands next to a timer
+// wrap whose overflow hasn't run yet. Then finds the shortest pulse it reads
+// right and prints the interrupts' share of the CPU for square waves and for
+// ultrasonic.jun, against the time pulseIn would hold up loop().
+#include "avrHost.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+#include "Pulse.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Times are hand counted estimates:
+// - the capture interrupt: ~55 to respond, save registers and read ICR1, the
+//   overflow count and TIFR1; ~55 more to build the time, subtract and
+//   switch the edge; ~40 for the flag write, restoring and returning
+// - the overflow interrupt ~30
+// - the core's timer0 interrupt ~80, every 1024 cycles
+// - junPulseTake ~25, with interrupts off for ~15 of them
+// - the noise canceler holds every capture back 4 cycles, which cancels out
+static const uint32_t captureRead = 55, captureSwitch = 55, captureRest = 40;
+static const uint32_t overflowCost = 30, timer0Cost = 80, timer0Every = 1024;
+static const uint32_t takeCost = 25, takeOff = 15, cancelerDelay = 4;
+
+// The signal on pin 8, as the cycles its edges come at. It starts low, so
+// the even ones rise.
+static std::vector<uint64_t> edges;
+static size_t nextEdge = 0;
+static uint64_t cycle = 0, timerStart = 0, nextWrap = 0, nextTimer0 = 0, offUntil = 0;
+static bool capturePending = false, overflowPending = false, timer0Pending = false;
+// The edge ICR1 holds, and the rise the interrupt keeps
+static size_t latched = 0, heldRise = 0;
+static uint64_t isrCycles = 0;
+
+// What came out: the worst error against the edges the interrupt worked
+// from, readings made from edges of different pulses, and the pulses read
+struct Tally {
+    int64_t worstWidth = 0, worstPeriod = 0;
+    uint32_t widths = 0, periods = 0, misread = 0;
+    uint64_t lastWidth = 0;
+};
+static Tally tally;
+// Readings loop() got wrong, and the widths read when it last took one
+static uint32_t loopWrong = 0, widthsTaken = 0;
+
+static uint64_t nextHardware() {
+    uint64_t edgeAt = nextEdge < edges.size() ? edges[nextEdge] : UINT64_MAX;
+    return std::min({ edgeAt, nextWrap, nextTimer0 });
+}
+
+// The timer hardware up to cycle upTo: captures, wraps and timer0's ticks
+static void hardware(uint64_t upTo) {
+    for (;;) {
+        uint64_t edgeAt = nextEdge < edges.size() ? edges[nextEdge] : UINT64_MAX;
+        uint64_t next = nextHardware();
+        if (next > upTo) break;
+        if (next == edgeAt) {
+            bool rising = nextEdge % 2 == 0;
+            if (rising == ((TCCR1B & (1 << ICES1)) != 0)) {
+                ICR1 = (edgeAt + cancelerDelay - timerStart) / 8;
+                capturePending = true;
+                latched = nextEdge;
+            }
+            nextEdge++;
+        } else if (next == nextWrap) {
+            overflowPending = true;
+            nextWrap += 8 * 65536;
+        } else {
+            timer0Pending = true;
+            nextTimer0 += timer0Every;
+        }
+    }
+}
+
+static void record(bool rising, bool hadRise, size_t edge) {
+    int64_t truth = edges[edge] - edges[heldRise];
+    if (rising && hadRise) {
+        tally.worstPeriod = std::max(tally.worstPeriod, std::abs((int64_t)junPulsePeriod * 8 - truth));
+        tally.periods++;
+        tally.misread += edge != heldRise + 2;
+    } else if (!rising && hadRise) {
+        tally.worstWidth = std::max(tally.worstWidth, std::abs((int64_t)junPulseWidth * 8 - truth));
+        tally.widths++;
+        tally.misread += edge != heldRise + 1;
+        tally.lastWidth = truth;
+    }
+}
+
+static void capture() {
+    uint64_t begun = cycle;
+    cycle += captureRead;
+    hardware(cycle);
+    // TIFR1 shows a wrap still waiting for its interrupt; a write of ICF1
+    // there is the interrupt clearing the flag
+    TIFR1 = overflowPending ? 1 << TOV1 : 0;
+    uint8_t sense = TCCR1B;
+    bool hadRise = junPulseHaveRise;
+    size_t edge = latched;
+    TIMER1_CAPT_vect_host();
+    // Edges before the switch are still taken the old way, and the flag write
+    // after it clears what they latched
+    uint8_t switched = TCCR1B;
+    TCCR1B = sense;
+    cycle += captureSwitch;
+    hardware(cycle);
+    TCCR1B = switched;
+    if ((switched ^ sense) & (1 << ICES1)) {
+        // Changing the edge can set the flag
+        capturePending = true;
+    }
+    if (TIFR1 & (1 << ICF1)) {
+        capturePending = false;
+    }
+    cycle += captureRest;
+    isrCycles += cycle - begun;
+    bool rising = sense & (1 << ICES1);
+    record(rising, hadRise, edge);
+    if (rising) {
+        heldRise = edge;
+    }
+}
+
+// Moves the clock on, running the interrupts as they come due and interrupts
+// are on. The capture interrupt goes before the overflow, which goes before
+// timer0's.
+static void spend(uint64_t cycles) {
+    uint64_t until = cycle + cycles;
+    for (;;) {
+        uint64_t runAt = std::max(cycle, offUntil), next = nextHardware();
+        bool pending = capturePending || overflowPending || timer0Pending;
+        if (!(pending && runAt <= until && runAt < next)) {
+            if (next > until) break;
+            hardware(next);
+            cycle = std::max(cycle, next);
+            continue;
+        }
+        cycle = runAt;
+        if (capturePending) {
+            capturePending = false;
+            capture();
+        } else if (overflowPending) {
+            overflowPending = false;
+            TIMER1_OVF_vect_host();
+            cycle += overflowCost;
+            isrCycles += overflowCost;
+        } else {
+            timer0Pending = false;
+            cycle += timer0Cost;
+        }
+    }
+    cycle = std::max(cycle, until);
+}
+
+static void beginCapture(const std::vector<uint64_t>& signal) {
+    edges = signal;
+    nextEdge = 0;
+    capturePending = overflowPending = timer0Pending = false;
+    junPulseBeginCapture();
+    timerStart = cycle;
+    nextWrap = cycle + 8 * 65536;
+    nextTimer0 = cycle + timer0Every;
+    offUntil = 0;
+    isrCycles = 0;
+    tally = Tally();
+    widthsTaken = 0;
+    check(TCCR1B == ((1 << ICNC1) | (1 << ICES1) | (1 << CS11)) && TIMSK1 == ((1 << ICIE1) | (1 << TOIE1)),
+          "beginCapture didn't set Timer1 up for input capture");
+}
+
+// loop() taking a width the way Pulse:width() does, checked against the last
+// pulse read and that it hasn't had it already. Returns whether one was
+// there.
+static bool take() {
+    offUntil = cycle + takeOff;
+    uint32_t us = 0;
+    bool found = junPulseTake(junPulseNewWidth, junPulseWidth, us);
+    if (found) {
+        // Whole microseconds, rounded down
+        loopWrong += us * 16 > tally.lastWidth + 8 || us * 16 + 24 < tally.lastWidth;
+        loopWrong += tally.widths == widthsTaken;
+        widthsTaken = tally.widths;
+    }
+    spend(takeCost);
+    return found;
+}
+
+// Runs the signal through with loop() taking widths every pollCycles and
+// with interrupts off for up to offCycles at random besides
+static void run(uint64_t pollCycles, uint32_t offCycles = 0) {
+    loopWrong = 0;
+    while (nextEdge < edges.size() || cycle < edges.back() + 1000) {
+        spend(pollCycles);
+        if (offCycles > 0) {
+            offUntil = cycle + rand() % offCycles;
+        }
+        take();
+    }
+}
+
+// Pulses and gaps between lo and hi us, spread evenly on a log scale, from
+// now on
+static std::vector<uint64_t> randomPulses(uint32_t count, double lo, double hi) {
+    std::vector<uint64_t> signal;
+    uint64_t at = cycle + 16 * 100;
+    for (uint32_t i = 0; i < 2 * count; i++) {
+        at += 16 * lo * pow(hi / lo, (double)rand() / RAND_MAX);
+        signal.push_back(at);
+    }
+    return signal;
+}
+
+static void accuracy() {
+    srand(1);
+    beginCapture(randomPulses(20000, 20, 40000));
+    run(16 * 200, 160);
+    printf("  20000 pulses and gaps 20us to 40ms: %u widths, %u periods, worst %.2fus and %.2fus out, %u misread, "
+           "%u loop() readings wrong\n", tally.widths, tally.periods, tally.worstWidth / 16.0, tally.worstPeriod / 16.0,
+           tally.misread, loopWrong);
+    check(tally.widths == 20000 && tally.periods == 19999, "a pulse wasn't read");
+    check(tally.worstWidth < 8 && tally.worstPeriod < 8, "a reading was more than a tick out");
+    check(tally.misread == 0 && loopWrong == 0, "a reading was made from the wrong edges");
+
+    // Edges right next to the timer's wraps, with the overflow interrupt held
+    // up behind code with interrupts off
+    std::vector<uint64_t> signal;
+    for (uint32_t k = 1; k <= 2000; k++) {
+        signal.push_back(cycle + k * 8 * 65536 - 1000 + rand() % 2000);
+    }
+    beginCapture(signal);
+    loopWrong = 0;
+    for (uint32_t k = 1; k <= 2000; k++) {
+        uint64_t wrap = timerStart + k * 8 * 65536;
+        spend(wrap - 200 - rand() % 400 - cycle);
+        offUntil = cycle + 200 + rand() % 1200;
+        take();
+        spend(16 * 200);
+    }
+    printf("  2000 edges within 63us of a timer wrap: %u widths, %u periods, worst %.2fus and %.2fus out\n",
+           tally.widths, tally.periods, tally.worstWidth / 16.0, tally.worstPeriod / 16.0);
+    check(tally.widths == 1000 && tally.worstWidth < 8 && tally.worstPeriod < 8 && tally.misread == 0 &&
+              loopWrong == 0, "an edge next to a wrap was read a wrap out");
+}
+
+// The shortest pulse read right every time, with timer0 and loop() running
+static void shortest() {
+    uint32_t shortestRight = 0;
+    for (uint32_t width = 30; width >= 2; width--) {
+        std::vector<uint64_t> signal;
+        uint64_t at = cycle + 16 * 100;
+        for (int i = 0; i < 500; i++) {
+            at += 16 * 100 + rand() % 1024;
+            signal.push_back(at);
+            signal.push_back(at + 16 * width);
+            at += 16 * width;
+        }
+        beginCapture(signal);
+        run(16 * 200);
+        bool right = tally.widths == 500 && tally.misread == 0 && tally.worstWidth < 8;
+        if (!right) break;
+        shortestRight = width;
+    }
+    printf("  pulses of %uus and longer were all read right; below that an edge can come before the interrupt "
+           "has switched to it\n", shortestRight);
+    check(shortestRight > 0 && shortestRight <= 15, "pulses of 15us weren't read right");
+}
+
+static void overhead() {
+    for (uint32_t hz : { 100, 1000, 10000, 20000 }) {
+        std::vector<uint64_t> signal;
+        uint64_t half = F_CPU / hz / 2;
+        for (uint64_t at = cycle + half; at < cycle + F_CPU; at += half) {
+            signal.push_back(at);
+        }
+        beginCapture(signal);
+        uint64_t begun = cycle;
+        run(16 * 200);
+        printf("  %5uHz square wave: interrupts %5.2f%% of the CPU, worst %.2fus out, %u misread\n", hz,
+               100.0 * isrCycles / (cycle - begun), std::max(tally.worstWidth, tally.worstPeriod) / 16.0,
+               tally.misread);
+        check(tally.misread == 0 && tally.widths == signal.size() / 2, "a square wave wasn't read right");
+    }
+
+    // ultrasonic.jun: a ping every 60ms, the echo starting ~450us after it
+    // and lasting 150us to 25ms. pulseIn holds loop() from the ping to the end
+    // of the echo.
+    std::vector<uint64_t> signal;
+    uint64_t blocked = 0;
+    for (int i = 0; i < 100; i++) {
+        uint64_t ping = cycle + i * 16 * 60000 + 16 * 1000;
+        uint64_t echo = 16 * (150 + rand() % 24850);
+        signal.push_back(ping + 16 * 450);
+        signal.push_back(ping + 16 * 450 + echo);
+        blocked += 16 * 450 + echo;
+    }
+    beginCapture(signal);
+    uint64_t begun = cycle;
+    run(16 * 1000);
+    printf("  ultrasonic.jun, a ping every 60ms: interrupts %.3f%% of the CPU, where pulseIn would hold up loop() "
+           "%.0f%% of the time\n", 100.0 * isrCycles / (cycle - begun), 100.0 * blocked / (cycle - begun));
+    check(tally.widths == 100 && tally.worstWidth < 8, "an echo wasn't read right");
+}
+
+int main() {
+    printf("accuracy\n");
+    accuracy();
+    shortest();
+    printf("overhead (estimated)\n");
+    overhead();
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+// Runs lib/SerialIn.jun on the PC against a model of the Arduino core's
+// serial receive side: bytes arrive from the UART at the baud rate and the
+// receive interrupt puts them in a 64 byte buffer, losing them when it is
+// full. Checks that lines and COBS frames come out exactly as sent, that
+// overlong and malformed ones are thrown away without harming the next, and
+// toInt against strtol. Then streams lines in under different amounts of
+// other work in loop() and prints the lines handled a second, the bytes
+// lost and how long after its last byte a line fires.
+#include "avrHost.h"
+
+#include <string>
+#include <vector>
+
+#include "SerialIn.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Times are hand counted estimates: the receive interrupt ~70 a byte;
+// Serial.available ~20 and Serial.read ~40; junSerialInFill ~25 a byte and
+// ~30 to finish a line, COBS ~15 a byte more; lines() and the sink ~40
+static const uint32_t isrCost = 70, availableCost = 20, readCost = 40;
+static const uint32_t fillCost = 25, endCost = 30, cobsCost = 15, callCost = 40;
+
+static uint64_t cycle = 0, byteCycles = 1389;
+// Bytes on their way in, and when the next one finishes arriving
+static std::string incoming;
+static size_t nextIn = 0;
+static uint64_t nextAt = 0;
+// The core's receive buffer, 63 bytes usable
+static std::string rx;
+static uint32_t lost = 0;
+// When each delimiter arrived, by its position in incoming
+static std::vector<uint64_t> arrived;
+static bool binary = false;
+
+// Moves the clock on, with the receive interrupts that come due meanwhile
+static void spend(uint64_t cycles) {
+    cycle += cycles;
+    while (nextIn < incoming.size() && nextAt <= cycle) {
+        cycle += isrCost;
+        if (rx.size() < 63) {
+            rx.push_back(incoming[nextIn]);
+        } else {
+            lost++;
+        }
+        arrived[nextIn] = nextAt;
+        nextIn++;
+        nextAt += byteCycles;
+    }
+    hostMicros = cycle / 16;
+}
+
+static int rxAvailable() {
+    spend(availableCost);
+    return rx.size();
+}
+
+static int rxRead() {
+    spend(readCost + fillCost + (binary ? cobsCost : 0));
+    if (rx.empty()) return -1;
+    int b = (uint8_t)rx[0];
+    rx.erase(0, 1);
+    return b;
+}
+
+// Starts sending text, a byte every byteCycles from now
+static void send(const std::string& text) {
+    incoming = text;
+    arrived.assign(text.size(), 0);
+    nextIn = 0;
+    nextAt = cycle + byteCycles;
+}
+
+static void fresh() {
+    junSerialInLength = 0;
+    junSerialInReady = junSerialInOverflowed = false;
+    junSerialInOverflows = 0;
+    rx.clear();
+    lost = 0;
+}
+
+// lines() and frames(), as the Juniper functions call them
+static bool lines() {
+    spend(callCost);
+    bool ready = junSerialInFill('\n', false);
+    if (ready) spend(endCost);
+    return ready;
+}
+
+static bool frames() {
+    spend(callCost);
+    bool ready = junSerialInFill(0, true);
+    if (ready) spend(endCost + cobsCost * junSerialInLength);
+    return ready;
+}
+
+static std::string current() {
+    return std::string((const char*)junSerialIn, junSerialInLength);
+}
+
+static void text() {
+    binary = false;
+    fresh();
+    srand(1);
+    std::vector<std::string> sent;
+    std::string stream;
+    uint32_t tooLong = 0;
+    for (int i = 0; i < 20000; i++) {
+        std::string line;
+        int len = rand() % 10 == 0 ? rand() % 100 : rand() % 40;
+        for (int k = 0; k < len; k++) {
+            line.push_back(' ' + rand() % 95);
+        }
+        // The \r of a \r\n ending doesn't count towards the length
+        stream += line + (rand() % 2 ? "\r\n" : "\n");
+        if (line.size() > JUN_SERIAL_IN) {
+            tooLong++;
+        } else {
+            sent.push_back(line);
+        }
+    }
+    send(stream);
+    std::vector<std::string> got;
+    bool terminated = true;
+    while (nextIn < incoming.size() || !rx.empty()) {
+        spend(16 * 50);
+        if (lines()) {
+            got.push_back(current());
+            terminated &= junSerialIn[junSerialInLength] == 0;
+        }
+    }
+    printf("  %zu lines up to 99 bytes at 115200 baud: %zu came out, %u overflows counted for %u too long, %u "
+           "bytes lost\n", sent.size() + tooLong, got.size(), junSerialInOverflows, tooLong, lost);
+    check(got == sent, "a line didn't come out as sent");
+    check(junSerialInOverflows == tooLong, "overflows() doesn't count the lines that were too long");
+    check(terminated, "a line wasn't zero terminated");
+    check(lost == 0, "bytes were lost with a 50us loop");
+}
+
+static std::string cobs(const std::string& data) {
+    std::string out;
+    size_t code = 0;
+    out.push_back(1);
+    for (char c : data) {
+        if (c == 0) {
+            code = out.size();
+            out.push_back(1);
+        } else {
+            out.push_back(c);
+            out[code]++;
+        }
+    }
+    out.push_back(0);
+    return out;
+}
+
+static void cobsFrames() {
+    binary = true;
+    fresh();
+    srand(2);
+    std::vector<std::string> sent;
+    std::string stream;
+    uint32_t bad = 0, tooLong = 0;
+    for (int i = 0; i < 20000; i++) {
+        std::string frame;
+        int len = rand() % 10 == 0 ? rand() % 80 : rand() % 40;
+        for (int k = 0; k < len; k++) {
+            frame.push_back(rand() % 3 == 0 ? 0 : rand() % 256);
+        }
+        std::string encoded = cobs(frame);
+        if (frame.size() > JUN_SERIAL_IN) {
+            tooLong++;
+        } else if (rand() % 20 == 0) {
+            // A code byte pointing past the end of the frame
+            encoded[0] = encoded.size() + 5;
+            bad++;
+        } else {
+            sent.push_back(frame);
+        }
+        stream += encoded;
+    }
+    send(stream);
+    std::vector<std::string> got;
+    while (nextIn < incoming.size() || !rx.empty()) {
+        spend(16 * 50);
+        if (frames()) {
+            got.push_back(current());
+        }
+    }
+    printf("  %zu COBS frames: %zu came out, %u malformed thrown away, %u overflows counted for %u too long\n",
+           sent.size() + bad + tooLong, got.size(), bad, junSerialInOverflows, tooLong);
+    check(got == sent, "a frame didn't decode to what was sent");
+    check(junSerialInOverflows == tooLong, "overflows() doesn't count the frames that were too long");
+}
+
+static void toInt() {
+    srand(3);
+    uint32_t wrong = 0;
+    for (int i = 0; i < 100000; i++) {
+        char line[JUN_SERIAL_IN + 1];
+        int32_t n = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand()) >> (rand() % 32);
+        int len = snprintf(line, sizeof(line), "pwm %ld%s", (long)n, rand() % 2 ? "" : "x9");
+        memcpy(junSerialIn, line, len + 1);
+        junSerialInLength = len;
+        wrong += junSerialInToInt(4) != strtol(line + 4, nullptr, 10);
+    }
+    // Past the end of the line, and nothing but a sign
+    junSerialInLength = 0;
+    wrong += junSerialInToInt(4) != 0;
+    memcpy(junSerialIn, "-", 2);
+    junSerialInLength = 1;
+    wrong += junSerialInToInt(0) != 0;
+    printf("  100000 numbers: %u parsed differently from strtol\n", wrong);
+    check(wrong == 0, "toInt parsed a number differently from strtol");
+}
+
+// Lines of lineBytes back to back at baud while loop() does work us of
+// other things besides lines()
+static void stream(uint32_t baud, uint32_t lineBytes, double work, uint32_t seconds, bool expectClean) {
+    binary = false;
+    fresh();
+    byteCycles = F_CPU * 10 / baud;
+    uint32_t lineCount = seconds * baud / 10 / lineBytes;
+    std::string text;
+    std::vector<size_t> ends;
+    for (uint32_t i = 0; i < lineCount; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "%0*u\n", (int)lineBytes - 1, i);
+        text += line;
+        ends.push_back(text.size() - 1);
+    }
+    send(text);
+    uint64_t begun = cycle, worst = 0, total = 0, loops = 0;
+    uint32_t out = 0, wrong = 0;
+    while (nextIn < incoming.size() || !rx.empty()) {
+        spend(work * 16);
+        loops++;
+        if (lines()) {
+            // Which line this is, from its number
+            uint32_t n = junSerialInToInt(0);
+            bool whole = junSerialInLength == lineBytes - 1 && n < lineCount;
+            wrong += !whole;
+            if (whole) {
+                uint64_t latency = cycle - arrived[ends[n]];
+                worst = std::max(worst, latency);
+                total += latency;
+                out++;
+            }
+        }
+    }
+    double elapsed = (double)(cycle - begun) / F_CPU;
+    printf("  %6u baud, %5.2fms of other work: %5.0f lines/s in, %5.0f handled, %5u bytes lost, %4u lines "
+           "damaged, fired %6.0fus after the newline on average, %6.0fus at worst\n", baud, work / 1000,
+           lineCount / elapsed, out / elapsed, lost, wrong, out ? total / 16.0 / out : 0, worst / 16.0);
+    if (expectClean) {
+        check(lost == 0 && wrong == 0 && out == lineCount, "lines were lost with loop() keeping up");
+        check(worst / 16.0 <= 2 * (elapsed * 1e6 / loops) + 100, "a line fired more than two loops late");
+    }
+    byteCycles = 1389;
+}
+
+int main() {
+    hostSerialAvailable = rxAvailable;
+    hostSerialRead = rxRead;
+    printf("lines\n");
+    text();
+    printf("frames\n");
+    cobsFrames();
+    printf("toInt\n");
+    toInt();
+    // lines() hands over at most one line a call, so loop() has to run at
+    // least as often as lines come in
+    printf("streaming 16 byte lines (times estimated)\n");
+    stream(9600, 16, 50, 10, true);
+    stream(115200, 16, 50, 10, true);
+    stream(115200, 16, 1000, 10, true);
+    stream(115200, 16, 2000, 10, false);
+    stream(115200, 16, 8000, 10, false);
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+// Runs lib/SerialOut.jun on the PC against a model of the Arduino core's
+// serial transmit side: a 64 byte buffer drained by the UART at 115200 baud,
+// with a write that waits for room when the buffer is full. Checks the
+// formatters against printf, that lines come out whole or not at all and
+// that the [dropped N] notices add up. Then runs telemetry.jun's loop with
+// both print paths and prints the throughput and the slowest loop.
+#include "avrHost.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+// avr-libc's math.h has isnan outside std
+using std::isnan;
+
+#include "SerialOut.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Times are hand counted estimates:
+// - HardwareSerial::write ~60 a byte, and the UART data register empty
+//   interrupt that moves it out ~75
+// - SerialOut: a decimal ~140 for the ten powers plus ~10 a subtraction, so
+//   ~10 per unit of each digit; a float ~350 more for the multiply and the
+//   conversions; putting a print in the ring ~20 and ~9 a byte; pump ~30
+//   and ~15 for each availableForWrite
+// - Io through Print: ~100 and a 32-bit divide, ~620, per digit; a float
+//   ~300 and ~950 per decimal place (a multiply, a conversion and a digit
+//   printed through printNumber)
+// - the rest of telemetry.jun's loop: micros, tick, the button and its edge
+//   and the two Clock:every ~300
+static const uint32_t writeCost = 60, uartIsrCost = 75;
+static const uint32_t numberCost = 140, subtractCost = 10, floatCost = 350;
+static const uint32_t putCost = 20, putByteCost = 9, pumpCost = 30, roomCost = 15;
+static const uint32_t ioNumberCost = 100, ioDigitCost = 620, ioFloatCost = 300, ioPlaceCost = 950;
+static const uint32_t loopCost = 300;
+
+// 10 bits a byte at 115200 baud
+static const uint64_t byteCycles = 1389;
+
+static uint64_t cycle = 0, waited = 0;
+// When each byte sent so far starts on the wire. A byte leaves the buffer
+// when it starts; the extra byte the data register holds is left out.
+static std::vector<uint64_t> byteStarts;
+static size_t leftBuffer = 0, interruptsCharged = 0;
+static std::string wire;
+
+// Moves the clock on, including the UART interrupts that come due meanwhile
+static void spend(uint64_t cycles) {
+    cycle += cycles;
+    while (interruptsCharged < byteStarts.size() && byteStarts[interruptsCharged] <= cycle) {
+        cycle += uartIsrCost;
+        interruptsCharged++;
+    }
+    hostMicros = cycle / 16;
+}
+
+static int uartRoom() {
+    while (leftBuffer < byteStarts.size() && byteStarts[leftBuffer] <= cycle) {
+        leftBuffer++;
+    }
+    return 63 - (int)(byteStarts.size() - leftBuffer);
+}
+
+static void uartByte(uint8_t b) {
+    spend(writeCost);
+    // HardwareSerial::write waits for a byte to leave when the buffer is full
+    if (uartRoom() == 0) {
+        waited += byteStarts[leftBuffer] - cycle;
+        spend(byteStarts[leftBuffer] - cycle);
+        uartRoom();
+    }
+    uint64_t start = byteStarts.empty() ? cycle : std::max(cycle, byteStarts.back() + byteCycles);
+    byteStarts.push_back(start);
+    wire.push_back((char)b);
+}
+
+static uint32_t digitSum(const char* text, uint8_t len) {
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        sum += text[i] >= '0' && text[i] <= '9' ? text[i] - '0' : 0;
+    }
+    return sum;
+}
+
+// SerialOut's prints, as printStr, printInt and printFloatPlaces do them
+static void outStr(const char* str) {
+    uint16_t len = strlen(str);
+    spend(putCost + putByteCost * len);
+    junSerialPut(str, len);
+}
+
+static void outInt(int32_t n) {
+    char out[11];
+    uint8_t len = junSerialFormatSigned(n, out);
+    spend(numberCost + subtractCost * digitSum(out, len) + putCost + putByteCost * len);
+    junSerialPut(out, len);
+}
+
+static void outFloat(float f, int32_t places) {
+    char out[24];
+    uint8_t len = junSerialFormatFloat(f, places < 0 ? 0 : places, out);
+    spend(floatCost + 2 * numberCost + subtractCost * digitSum(out, len) + putCost + putByteCost * len);
+    junSerialPut(out, len);
+}
+
+static void pump() {
+    uint16_t chunks = (junSerialUsed + 62) / 63 + 1;
+    spend(pumpCost + roomCost * chunks);
+    junSerialPump();
+}
+
+// Io's prints: the same text, formatted by Print and written a byte at a time
+static void ioText(const char* text, uint32_t cost) {
+    spend(cost);
+    for (const char* c = text; *c; c++) {
+        uartByte(*c);
+    }
+}
+
+static void ioInt(int32_t n) {
+    char out[16];
+    int len = snprintf(out, sizeof(out), "%ld", (long)n);
+    ioText(out, ioNumberCost + ioDigitCost * (len - (n < 0)));
+}
+
+static void ioFloat(float f, int32_t places) {
+    char out[24];
+    snprintf(out, sizeof(out), "%.*f", (int)places, f);
+    uint32_t whole = std::strchr(out, '.') - out - (f < 0);
+    ioText(out, ioFloatCost + ioNumberCost + ioDigitCost * whole + ioPlaceCost * places);
+}
+
+static void fresh(bool coalesce) {
+    junSerialHead = junSerialTail = junSerialUsed = 0;
+    junSerialDropped = junSerialUnreported = 0;
+    junSerialLine = 0;
+    junSerialSkipping = false;
+    // What SerialOut:setPolicy does
+    junSerialCoalesce = coalesce;
+    byteStarts.clear();
+    leftBuffer = interruptsCharged = 0;
+    wire.clear();
+    waited = 0;
+}
+
+static std::string formatted(uint8_t (*format)(uint32_t, char*), uint32_t n) {
+    char out[40];
+    return std::string(out, format(n, out));
+}
+
+static void formatters() {
+    srand(1);
+    uint32_t wrong = 0, tried = 0;
+    std::vector<int32_t> ints = { 0, 1, -1, 9, 10, 99, 100, INT32_MAX, INT32_MIN, 1000000000, -999999999 };
+    for (int i = 0; i < 100000; i++) {
+        int32_t n = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand()) >> (rand() % 32);
+        ints.push_back(n);
+    }
+    for (int32_t n : ints) {
+        char out[40], expect[40];
+        // Decimal, and the unsigned two's complement for bases 16, 8 and 2
+        snprintf(expect, sizeof(expect), "%ld", (long)n);
+        wrong += std::string(out, junSerialFormatSigned(n, out)) != expect;
+        snprintf(expect, sizeof(expect), "%lX", (unsigned long)(uint32_t)n);
+        wrong += std::string(out, junSerialFormatShift(n, 4, out)) != expect;
+        snprintf(expect, sizeof(expect), "%lo", (unsigned long)(uint32_t)n);
+        wrong += std::string(out, junSerialFormatShift(n, 3, out)) != expect;
+        std::string binary;
+        for (uint32_t u = n; binary.empty() || u != 0; u >>= 1) {
+            binary.insert(binary.begin(), '0' + (u & 1));
+        }
+        wrong += std::string(out, junSerialFormatShift(n, 1, out)) != binary;
+        tried += 4;
+    }
+    wrong += formatted(junSerialFormatUnsigned, UINT32_MAX) != "4294967295";
+    printf("  %u integers in bases 10, 16, 8 and 2: %u different from printf\n", tried, wrong);
+    check(wrong == 0, "an integer formatted differently from printf");
+
+    // Floats land within half the last place, plus what the float multiply
+    // loses on large values
+    uint32_t off = 0, floats = 0;
+    for (int i = 0; i < 100000; i++) {
+        float f = (rand() / (float)RAND_MAX - 0.5f) * std::pow(10.0f, rand() % 12 - 3);
+        uint8_t places = rand() % 8;
+        char out[24];
+        std::string text(out, junSerialFormatFloat(f, places, out));
+        uint8_t shown = std::min(places, (uint8_t)6);
+        size_t dot = text.find('.');
+        bool shape = shown == 0 ? dot == std::string::npos : dot != std::string::npos && text.size() - dot - 1 == shown;
+        double scale = std::pow(10.0, shown);
+        off += !shape || std::fabs(std::strtod(text.c_str(), nullptr) - f) > 0.6 / scale + std::fabs(f) * 1.2e-7;
+        floats++;
+    }
+    char out[24];
+    bool special = std::string(out, junSerialFormatFloat(NAN, 2, out)) == "nan" &&
+                   std::string(out, junSerialFormatFloat(-5e9f, 2, out)) == "-ovf" &&
+                   std::string(out, junSerialFormatFloat(0.999f, 2, out)) == "1.00" &&
+                   std::string(out, junSerialFormatFloat(2.5f, 0, out)) == "3";
+    printf("  %u floats with 0 to 7 places: %u off by more than half the last place\n", floats, off);
+    check(off == 0, "a float formatted away from its value");
+    check(special, "nan, ovf or a carry into the whole part formatted wrongly");
+}
+
+// Lines on the wire: every one is a whole "n,n,n.nnn" line, or a notice
+static void lines() {
+    for (bool coalesce : { true, false }) {
+        fresh(coalesce);
+        uint32_t sent = 0;
+        for (uint32_t n = 1; n <= 20000; n++) {
+            // A line of 2 to 5 prints, and the port takes a few bytes
+            // between lines
+            outInt(n);
+            for (int k = rand() % 4; k > 0; k--) {
+                outStr(",");
+                outInt(rand() % 100000);
+            }
+            outStr("\n");
+            sent++;
+            spend(byteCycles * (rand() % 20));
+            if (rand() % 4 == 0) {
+                pump();
+            }
+        }
+        while (junSerialUsed > 0 || junSerialUnreported > 0) {
+            spend(byteCycles * 63);
+            pump();
+        }
+        uint32_t whole = 0, broken = 0, reported = 0, notices = 0, lastSeen = 0, gaps = 0;
+        size_t from = 0;
+        while (from < wire.size()) {
+            size_t end = wire.find('\n', from);
+            std::string line = wire.substr(from, end - from);
+            from = end == std::string::npos ? wire.size() : end + 1;
+            if (line.rfind("[dropped ", 0) == 0) {
+                notices++;
+                reported += strtoul(line.c_str() + 9, nullptr, 10);
+                continue;
+            }
+            char* at = nullptr;
+            uint32_t n = strtoul(line.c_str(), &at, 10);
+            bool ok = n > lastSeen && end != std::string::npos;
+            while (ok && *at == ',') {
+                strtoul(at + 1, &at, 10);
+                ok = at[-1] >= '0' && at[-1] <= '9';
+            }
+            ok = ok && *at == 0;
+            broken += !ok;
+            whole += ok;
+            gaps += ok ? n - lastSeen - 1 : 0;
+            lastSeen = ok ? n : lastSeen;
+        }
+        gaps += sent - lastSeen;
+        printf("  %s: %u lines, %u came out whole, %u broken, %u dropped, %u notices saying %u\n",
+               coalesce ? "coalesce" : "dropNew ", sent, whole, broken, junSerialDropped, notices, reported);
+        check(broken == 0, "a line came out with a piece missing");
+        check(whole + junSerialDropped == sent && gaps == junSerialDropped, "the dropped count doesn't match the lines missing");
+        check(coalesce ? reported == junSerialDropped : notices == 0, "the notices don't add up to the dropped lines");
+    }
+}
+
+// Clock:every's deadline: skips ahead when the loop falls a whole interval
+// behind
+struct Every {
+    bool started = false;
+    uint32_t next = 0;
+    bool fire(uint32_t t, uint32_t interval) {
+        if (!started || (int32_t)(t - next) >= 0) {
+            uint32_t after = next + interval;
+            next = !started || (int32_t)(t - after) >= 0 ? t + interval : after;
+            started = true;
+            return true;
+        }
+        return false;
+    }
+};
+
+// telemetry.jun's loop for seconds, through SerialOut or through Io. Returns
+// the sample lines sent a second.
+static double telemetry(bool serialOut, uint32_t seconds) {
+    fresh(true);
+    Every sample, report;
+    uint32_t sequence = 0, worstLoop = 0, lastLoop = 0, lines = 0;
+    uint64_t worst = 0, begun = cycle, previous = cycle;
+    while (cycle < begun + (uint64_t)seconds * F_CPU) {
+        uint32_t t = micros();
+        worstLoop = std::max(worstLoop, t - lastLoop);
+        lastLoop = t;
+        worst = std::max(worst, cycle - previous);
+        previous = cycle;
+        spend(loopCost);
+        uint32_t now = millis();
+        if (sample.fire(now, 1)) {
+            sequence++;
+            lines++;
+            if (serialOut) {
+                outInt(sequence);
+                outStr(",");
+                outInt(now);
+                outStr(",");
+                outFloat(now * 0.001f, 3);
+                outStr("\n");
+            } else {
+                ioInt(sequence);
+                ioText(",", 0);
+                ioInt(now);
+                ioText(",", 0);
+                ioFloat(now * 0.001f, 3);
+                ioText("\n", 0);
+            }
+        }
+        if (report.fire(now, 1000)) {
+            if (serialOut) {
+                outStr("# SerialOut worst loop us: ");
+                outInt(worstLoop);
+                outStr(" dropped: ");
+                outInt(junSerialDropped);
+                outStr("\n");
+            } else {
+                ioText("# Io worst loop us: ", 0);
+                ioInt(worstLoop);
+                ioText("\n", 0);
+            }
+            worstLoop = 0;
+        }
+        if (serialOut) {
+            pump();
+        }
+    }
+    double elapsed = (double)(cycle - begun) / F_CPU;
+    size_t delivered = 0;
+    for (uint64_t start : byteStarts) {
+        delivered += start + byteCycles <= cycle;
+    }
+    // Sample lines start with a digit, the reports with '#'
+    uint32_t samples = 0;
+    for (size_t i = 0; i + 1 < wire.size(); i++) {
+        samples += (i == 0 || wire[i - 1] == '\n') && wire[i] >= '0' && wire[i] <= '9';
+    }
+    double bytesPerSecond = delivered / elapsed;
+    printf("  %-9s %5.0f bytes/s (%3.0f%% of the line), %4.0f of %4.0f samples/s sent, waits %4.1f%% of the "
+           "time, slowest loop %6.0fus\n", serialOut ? "SerialOut" : "Io", bytesPerSecond,
+           100 * bytesPerSecond / (F_CPU / (double)byteCycles), samples / elapsed, lines / elapsed,
+           100.0 * waited / (cycle - begun), worst * 1e6 / F_CPU);
+    check(bytesPerSecond > 0.95 * F_CPU / byteCycles, "the serial line was idle with lines to send");
+    if (serialOut) {
+        check(waited == 0, "SerialOut waited for the serial port");
+        check(worst * 1e6 / F_CPU < 500, "a SerialOut loop took over 500us");
+    }
+    return samples / elapsed;
+}
+
+int main() {
+    printf("formatters\n");
+    formatters();
+    printf("lines\n");
+    hostSerialRoom = uartRoom;
+    hostSerialByte = uartByte;
+    lines();
+    printf("telemetry.jun, 1kHz at 115200 baud (loop times estimated)\n");
+    double io = telemetry(false, 10);
+    double serialOut = telemetry(true, 10);
+    // The notices mustn't crowd out the lines
+    check(serialOut > 0.9 * io, "SerialOut sent far fewer samples than Io");
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+// Runs lib/Servo.jun's Timer1 interrupt on the PC with a cycle counted model
+// of the timer, the compare match and the Arduino core's timer0 interrupt.
+// Checks that the schedule merges switch offs the way the header says, that
+// every pulse in every frame comes from one whole schedule even when widths
+// change mid frame, that no compare is set too late to fire, and that
+// Servo:jitterMicros and isrMicros report what the model measured. Prints how
+// far pulses land from their widths for spread out, bunched and equal widths.
+#include "pinChange.h"
+
+// Interrupt times are hand counted estimates, as in pinChange.h. TCNT1 is
+// read at fixed points of the interrupt, so each read moves the clock on by
+// the cycles of the code since the one before:
+// - entry to the first read: respond and jmp ~9, prologue saving ~15
+//   registers and SREG ~33
+// - frame start, first read to the last: schedule swap and busy counters
+//   ~29, OCR1A and the first event ~24, and 14 per port to set the pins
+// - one event, to the lateness read: ~8 to find it and 16 per port to clear
+//   its pins; then ~22 to the next read, the check for another event due.
+//   If there is one, ~10 more for the time compare and going round again.
+// - last read: ~40 after a lateness read, ~28 after a check, for OCR1A
+// - epilogue and reti after the last read, ~46
+static const uint32_t entryCost = 42;
+static const uint32_t frameCost = 53, setPerPort = 14;
+static const uint32_t eventCost = 8, clearPerPort = 16;
+static const uint32_t checkCost = 22, loopCost = 10;
+static const uint32_t doneAfterLate = 40, doneAfterCheck = 28;
+static const uint32_t epilogueCost = 46;
+
+// The defaults, set here for the arrays below
+#define JUN_SERVO_CHANNELS 12
+#define JUN_SERVO_PORTS 4
+
+enum Read { Outside, Entered, FrameDone, Late, Check, Done };
+static Read nextRead = Outside;
+static bool afterCheck = false;
+static uint64_t cycle = 0;
+
+// Four ports of 8 pins, channel i on port i % 4, bit i / 4
+static uint8_t ports[JUN_SERVO_PORTS];
+static uint8_t portsSeen[JUN_SERVO_PORTS];
+static std::vector<uint64_t> rises[JUN_SERVO_CHANNELS], falls[JUN_SERVO_CHANNELS];
+
+static void notePorts() {
+    for (uint8_t i = 0; i < JUN_SERVO_CHANNELS; i++) {
+        uint8_t p = i % JUN_SERVO_PORTS, mask = 1 << (i / JUN_SERVO_PORTS);
+        if ((ports[p] ^ portsSeen[p]) & mask) {
+            (ports[p] & mask ? rises : falls)[i].push_back(cycle);
+        }
+    }
+    memcpy(portsSeen, ports, sizeof(ports));
+}
+
+static uint16_t hostTcnt1();
+#define TCNT1 hostTcnt1()
+
+#include "Servo.inc"
+
+static uint16_t hostTcnt1() {
+    const JunServoSchedule& s = junServoSchedules[junServoFront];
+    switch (nextRead) {
+        case Entered:
+            nextRead = junServoNext == 0 ? FrameDone : Late;
+            afterCheck = false;
+            break;
+        case FrameDone:
+            cycle += frameCost + setPerPort * junServoPortCount;
+            notePorts();
+            nextRead = Outside;
+            break;
+        case Late:
+            cycle += (afterCheck ? loopCost : 0) + eventCost + clearPerPort * junServoPortCount;
+            notePorts();
+            // junServoNext goes up after this read
+            nextRead = junServoNext + 1 <= s.count ? Check : Done;
+            afterCheck = false;
+            break;
+        case Check: {
+            cycle += checkCost;
+            uint16_t now = cycle / 8;
+            nextRead = (uint16_t)(now - junServoFrameStart) + JUN_SERVO_MERGE >= s.events[junServoNext - 1].time
+                ? Late : Done;
+            afterCheck = true;
+            return now;
+        }
+        case Done:
+            cycle += afterCheck ? doneAfterCheck : doneAfterLate;
+            nextRead = Outside;
+            break;
+        case Outside:
+            break;
+    }
+    return cycle / 8;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+struct Result {
+    // Switch off against the schedule, and pulse length against the width
+    // written, in us
+    double earliest, latest;
+    double shortest, longest;
+    // Largest Servo:jitterMicros and isrMicros seen, and the most the model
+    // measured for them
+    uint16_t jitter, isr;
+    double measuredLate, measuredIsr;
+    uint32_t missed;
+    uint32_t mixed;
+};
+
+// Runs frames frames with width(frame, channel) giving the width to write in
+// us, written from loop() when the frame is at fraction along (0 to 1)
+template<typename Width>
+static Result run(uint8_t channels, uint32_t frames, Width width, double along) {
+    // What Servo:attach sets up
+    memset(ports, 0, sizeof(ports));
+    memset(portsSeen, 0, sizeof(portsSeen));
+    junServoChannelCount = 0;
+    junServoPortCount = 0;
+    junServoStarted = false;
+    junServoLate = 0;
+    for (auto& r : rises) r.clear();
+    for (auto& f : falls) f.clear();
+    cycle = 1000;
+    nextRead = Outside;
+    junServoStart();
+    for (uint8_t i = 0; i < channels; i++) {
+        JunServoChannel& c = junServoChannels[i];
+        c.pin = i;
+        c.port = i % JUN_SERVO_PORTS;
+        c.mask = 1 << (i / JUN_SERVO_PORTS);
+        c.minMicros = 544;
+        c.maxMicros = 2400;
+        c.width = 0;
+        junServoPorts[c.port] = &ports[c.port];
+    }
+    junServoChannelCount = channels;
+    junServoPortCount = channels < JUN_SERVO_PORTS ? channels : JUN_SERVO_PORTS;
+
+    // Widths handed to the interrupt and the ones each frame ran with, in
+    // timer counts
+    std::vector<uint16_t> committed(channels, 0);
+    std::vector<std::vector<uint16_t>> active;
+    std::vector<uint64_t> frameStarts;
+    std::vector<uint64_t> isrCycles;
+    for (uint8_t i = 0; i < channels; i++) {
+        junServoSetWidth(i, width(0, i));
+        committed[i] = junServoChannels[i].width;
+    }
+
+    Result r = { 1e9, -1e9, 1e9, -1e9, 0, 0, 0, 0, 0, 0 };
+    uint64_t compare = (uint64_t)OCR1A * 8;
+    uint64_t cpu = cycle, overflows = cycle / timer0Period;
+    uint32_t frame = 0;
+    bool written = true;
+    uint64_t frameIsr = 0;
+    while (frame <= frames) {
+        uint64_t timerFlag = (overflows + 1) * timer0Period;
+        uint64_t servoTaken = compare > cpu ? compare : cpu;
+        uint64_t timerTaken = timerFlag > cpu ? timerFlag : cpu;
+        // Timer1 COMPA comes before TIMER0_OVF when both are waiting
+        if (servoTaken <= timerTaken) {
+            bool starting = junServoNext == 0;
+            if (starting) {
+                if (junServoPending) {
+                    active.push_back(committed);
+                } else {
+                    active.push_back(active.empty() ? committed : active.back());
+                }
+                frameStarts.push_back(compare);
+                isrCycles.push_back(frameIsr);
+                frameIsr = 0;
+                frame++;
+                written = false;
+            }
+            cycle = servoTaken + entryCost;
+            nextRead = Entered;
+            TIMER1_COMPA_vect_host();
+            // OCR1A was written just before the last read
+            uint16_t now = cycle / 8;
+            uint16_t ahead = OCR1A - now;
+            if (ahead == 0 || ahead > JUN_SERVO_FRAME) {
+                r.missed++;
+            }
+            compare = ((uint64_t)(cycle / 8) + (ahead == 0 ? 65536 : ahead)) * 8;
+            cycle += epilogueCost;
+            frameIsr += cycle - servoTaken;
+            cpu = cycle + 1;
+            if (starting) {
+                r.isr = junServoLastBusy > r.isr ? junServoLastBusy : r.isr;
+            }
+        } else {
+            overflows++;
+            cpu = timerTaken + timer0Cost + 1;
+        }
+        // loop() writes the next widths once the frame is far enough along,
+        // between interrupts
+        uint64_t writeAt = frameStarts.empty() ? 0 : frameStarts.back() + (uint64_t)(along * JUN_SERVO_FRAME * 8);
+        if (!written && frame < frames && cpu >= writeAt) {
+            cycle = cpu;
+            nextRead = Outside;
+            for (uint8_t i = 0; i < channels; i++) {
+                junServoSetWidth(i, width(frame, i));
+            }
+            for (uint8_t i = 0; i < channels; i++) {
+                committed[i] = junServoChannels[i].width;
+            }
+            written = true;
+        }
+        // What Servo:jitterMicros does, once a frame
+        if (junServoNext == 0 && junServoLate > 0) {
+            uint16_t jitter = junServoLate / JUN_SERVO_COUNTS_PER_US;
+            r.jitter = jitter > r.jitter ? jitter : r.jitter;
+            junServoLate = 0;
+        }
+    }
+    isrCycles.push_back(frameIsr);
+
+    // Every channel rises and falls once a frame. Frame 0 runs with no
+    // widths, so pins go high from frame 1.
+    for (uint8_t i = 0; i < channels; i++) {
+        size_t pulses = rises[i].size() < falls[i].size() ? rises[i].size() : falls[i].size();
+        check(pulses + 1 >= frames, "a pin missed a pulse");
+        for (size_t f = 0; f < pulses; f++) {
+            size_t at = std::upper_bound(frameStarts.begin(), frameStarts.end(), rises[i][f]) - frameStarts.begin() - 1;
+            const std::vector<uint16_t>& widths = active[at];
+            double late = (falls[i][f] - (frameStarts[at] + widths[i] * 8.0)) / 16;
+            double error = (falls[i][f] - rises[i][f] - widths[i] * 8.0) / 16;
+            r.earliest = late < r.earliest ? late : r.earliest;
+            r.latest = late > r.latest ? late : r.latest;
+            r.shortest = error < r.shortest ? error : r.shortest;
+            r.longest = error > r.longest ? error : r.longest;
+            // Random widths from the frame before or after put the pulse
+            // well away from the schedule
+            if (late < -(double)JUN_SERVO_MERGE_US - 1 || late > 40) {
+                r.mixed++;
+            }
+        }
+    }
+    r.measuredLate = r.latest;
+    for (uint64_t c : isrCycles) {
+        r.measuredIsr = c / 16.0 > r.measuredIsr ? c / 16.0 : r.measuredIsr;
+    }
+    r.isr /= JUN_SERVO_COUNTS_PER_US;
+    return r;
+}
+
+static void report(const char* name, const Result& r) {
+    printf("%-34s switch off %5.1f to %4.1fus from the schedule, pulses %5.1f to %4.1fus off\n", name, r.earliest,
+           r.latest, r.shortest, r.longest);
+    printf("%-34s jitterMicros %2u (worst late %4.1f), isrMicros %3u (whole interrupts %5.1f)\n", "", r.jitter,
+           r.measuredLate, r.isr, r.measuredIsr);
+    check(r.missed == 0, "OCR1A set after the count had passed it");
+    check(r.mixed == 0, "a pulse ran with widths from another schedule");
+    check(r.earliest >= -(double)JUN_SERVO_MERGE_US - 0.5, "a pulse ended more than the merge window early");
+    check(r.jitter + 1 >= r.measuredLate, "jitterMicros under the lateness measured");
+    check(r.isr <= r.measuredIsr, "isrMicros over the whole interrupt time");
+}
+
+// Checks a schedule built from widths against the rules in junServoRebuild
+static void checkSchedule(const std::vector<uint16_t>& widths) {
+    const JunServoSchedule& s = junServoSchedules[junServoFront ^ 1];
+    uint32_t cleared[JUN_SERVO_CHANNELS] = {};
+    for (uint8_t k = 0; k < s.count; k++) {
+        const JunServoEvent& e = s.events[k];
+        if (k > 0) {
+            check(e.time > s.events[k - 1].time, "events out of order");
+        }
+        for (uint8_t i = 0; i < widths.size(); i++) {
+            if (e.clear[i % JUN_SERVO_PORTS] & (1 << (i / JUN_SERVO_PORTS))) {
+                cleared[i]++;
+                check(e.time <= widths[i] && e.time + JUN_SERVO_MERGE >= widths[i], "pin cleared outside the window");
+            }
+        }
+    }
+    for (uint8_t i = 0; i < widths.size(); i++) {
+        check(cleared[i] == 1, "pin not cleared exactly once");
+        check(s.set[i % JUN_SERVO_PORTS] & (1 << (i / JUN_SERVO_PORTS)), "pin not set at the frame start");
+    }
+}
+
+int main() {
+    // Schedules for random widths, some of them close together
+    srand(1);
+    uint32_t events = 0, schedules = 10000;
+    for (uint32_t n = 0; n < schedules; n++) {
+        memset(junServoChannels, 0, sizeof(junServoChannels));
+        junServoChannelCount = JUN_SERVO_CHANNELS;
+        std::vector<uint16_t> widths;
+        for (uint8_t i = 0; i < JUN_SERVO_CHANNELS; i++) {
+            JunServoChannel& c = junServoChannels[i];
+            c.port = i % JUN_SERVO_PORTS;
+            c.mask = 1 << (i / JUN_SERVO_PORTS);
+            c.width = 3000 + rand() % (n % 2 ? 40 : 3000);
+            widths.push_back(c.width);
+        }
+        junServoRebuild();
+        checkSchedule(widths);
+        events += junServoSchedules[junServoFront ^ 1].count;
+    }
+    printf("%u schedules of %u widths checked, %.1f switch offs each after merging\n", schedules,
+           JUN_SERVO_CHANNELS, (double)events / schedules);
+
+    printf("interrupt cost (estimated): %u cycles to start a frame and %u for a lone event, with 4 ports\n",
+           entryCost + frameCost + 4 * setPerPort + epilogueCost,
+           entryCost + eventCost + 4 * clearPerPort + doneAfterLate + epilogueCost);
+
+    // New random widths every frame, written at different points in the
+    // frame, including while pulses are still going out
+    for (double along : { 0.02, 0.06, 0.5 }) {
+        char name[64];
+        snprintf(name, sizeof(name), "12 random, written %.0f%% in", along * 100);
+        Result r = run(12, 200, [](uint32_t, uint8_t) { return (uint16_t)(544 + rand() % 1857); }, along);
+        report(name, r);
+    }
+    // All the same: one switch off for every pin
+    Result r = run(12, 50, [](uint32_t, uint8_t) { return (uint16_t)1500; }, 0.5);
+    report("12 at 1500us", r);
+    // 2.5us apart, just outside the merge window, so every switch off is
+    // its own event and each comes due while the one before is handled
+    r = run(12, 50, [](uint32_t, uint8_t i) { return (uint16_t)(1500 + i * 5 / 2); }, 0.5);
+    report("12 at 1500us, 2.5us apart", r);
+    // 1us apart, merged in pairs and threes
+    r = run(12, 50, [](uint32_t, uint8_t i) { return (uint16_t)(1500 + i); }, 0.5);
+    report("12 at 1500us, 1us apart", r);
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Runs lib/ShiftOut.jun on the PC against a model of a 74HC595 chain on the
+// SPI pins: every bit clocks through the shift registers and the latch
+// pin's rising edge copies them to the outputs. Checks that after every
+// flush the chain's outputs are the frame, that nothing is sent when nothing
+// changed and that bits past the chain are ignored. Then times
+// shiftChain.jun's benchmark, bit-banged with Io:digWrite against ShiftOut.
+#include "avrHost.h"
+
+#include <initializer_list>
+
+#include "ShiftOut.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Times are hand counted estimates:
+// - digitalWrite (Io:digWrite) ~54: the pin's port and mask from flash, the
+//   PWM timer check and the write with interrupts off
+// - a bit-banged bit: three digitalWrites and the loop and branch ~12
+// - SPI.transfer ~21: 16 cycles shifting at 8MHz, the SPDR write, the SPIF
+//   wait and the read; flush's loop ~6 a byte
+// - flush: the dirty check ~4; beginTransaction ~20 and endTransaction ~5
+//   around the two latch writes
+// - setByte ~15
+static const uint32_t digitalWriteCost = 54, bitLoopCost = 12;
+static const uint32_t transferCost = 21, flushByteCost = 6;
+static const uint32_t dirtyCost = 4, transactionCost = 25;
+static const uint32_t setByteCost = 15;
+
+// shiftChain.jun's pins: latch 8, data 11 and clock 13, all on port B
+static const uint8_t latchPin = 8, latchMask = 1 << 0, dataMask = 1 << 3;
+
+// The chain: bit k of a chip is output Q(A+k). A clock shifts every chip up
+// one and QH' feeds the next chip's SER. Chip 0 is nearest the board.
+static uint8_t shifting[JUN_SHIFT_BYTES], outputs[JUN_SHIFT_BYTES];
+static uint32_t bytesSent = 0, latchHighShifts = 0;
+
+static void clockBit(bool in) {
+    for (uint8_t i = JUN_SHIFT_BYTES - 1; i > 0; i--) {
+        shifting[i] = shifting[i] << 1 | shifting[i - 1] >> 7;
+    }
+    shifting[0] = shifting[0] << 1 | in;
+}
+
+static void spiByte(uint8_t b) {
+    latchHighShifts += (PORTB & latchMask) != 0;
+    // MSB first
+    for (int k = 7; k >= 0; k--) {
+        clockBit(b >> k & 1);
+    }
+    bytesSent++;
+}
+
+// The latch copies on its rising edge: low while bits went in, high now
+static void latchIfRaised(bool wasLow) {
+    if (wasLow && (PORTB & latchMask)) {
+        memcpy(outputs, shifting, sizeof(outputs));
+    }
+}
+
+static bool flush() {
+    uint32_t before = bytesSent;
+    bool sent = junShiftFlush();
+    latchIfRaised(bytesSent > before && latchHighShifts == 0);
+    return sent;
+}
+
+static bool showsFrame() {
+    return memcmp(outputs, junShiftFrame, junShiftCount) == 0;
+}
+
+static void frames() {
+    srand(1);
+    for (uint8_t chips : { 1, 2, 8 }) {
+        memset(shifting, 0, sizeof(shifting));
+        memset(outputs, 0xFF, sizeof(outputs));
+        latchHighShifts = 0;
+        junShiftBegin(latchPin, chips);
+        check((DDRB & latchMask) && (PORTB & latchMask), "begin didn't leave the latch an output and high");
+        flush();
+        uint32_t wrong = 0, flushes = 0, idle = 0;
+        for (int i = 0; i < 20000; i++) {
+            int changes = rand() % 3;
+            for (int k = 0; k < changes; k++) {
+                if (rand() % 2) {
+                    junShiftSetBit(rand() % (8 * chips + 8), rand() % 2);
+                } else {
+                    junShiftSetByte(rand() % (chips + 1), rand() % 256);
+                }
+            }
+            bool dirty = junShiftDirty;
+            uint32_t before = bytesSent;
+            bool sent = flush();
+            flushes += sent;
+            idle += !dirty && bytesSent == before;
+            wrong += sent != dirty || !showsFrame() || (sent && bytesSent - before != chips);
+        }
+        // Nothing past the chain is kept
+        uint8_t beyond = 0;
+        for (uint8_t c = chips; c < JUN_SHIFT_BYTES; c++) {
+            beyond |= junShiftFrame[c];
+        }
+        printf("  %u chips: %u flushes sent, %u skipped with nothing changed, %u not matching the frame\n", chips,
+               flushes, idle, wrong);
+        check(wrong == 0, "the chain's outputs don't match the frame after a flush");
+        check(beyond == 0, "a write past the chain changed the frame");
+        check(latchHighShifts == 0, "bits were shifted with the latch high");
+    }
+
+    // Writing what is there already doesn't mark the frame dirty, refresh
+    // sends anyway, and a chain longer than JUN_SHIFT_BYTES is cut short
+    junShiftBegin(latchPin, 2);
+    flush();
+    junShiftSetByte(1, 0);
+    junShiftSetBit(3, false);
+    bool clean = !flush();
+    // What refresh does
+    junShiftDirty = true;
+    uint32_t before = bytesSent;
+    bool refreshed = flush() && bytesSent - before == 2;
+    junShiftBegin(latchPin, JUN_SHIFT_BYTES + 5);
+    check(clean, "writing the same value marked the frame dirty");
+    check(refreshed, "refresh didn't send the frame");
+    check(junShiftCount == JUN_SHIFT_BYTES, "begin didn't cut the chain to JUN_SHIFT_BYTES");
+}
+
+// shiftChain.jun's light along 16 LEDs, one step a loop
+static void light() {
+    junShiftBegin(latchPin, 2);
+    flush();
+    uint16_t position = 0;
+    uint32_t wrong = 0;
+    for (int step = 0; step < 100; step++) {
+        junShiftSetBit(position, false);
+        position = position >= 15 ? 0 : position + 1;
+        junShiftSetBit(position, true);
+        flush();
+        uint16_t lit = outputs[0] | outputs[1] << 8;
+        wrong += lit != 1 << position;
+    }
+    printf("  shiftChain.jun's light: %u of 100 steps with the wrong LED lit\n", wrong);
+    check(wrong == 0, "the light lit the wrong LED");
+}
+
+// shiftChain.jun's bitBangByte, one Io:digWrite per bit plus two for the
+// clock, into the same chain
+static uint64_t bitBangByte(uint8_t value) {
+    for (int i = 0; i < 8; i++) {
+        digitalWrite(11, value & (128 >> i) ? HIGH : LOW);
+        digitalWrite(13, HIGH);
+        clockBit(PORTB & dataMask);
+        digitalWrite(13, LOW);
+    }
+    return 8 * (3 * digitalWriteCost + bitLoopCost);
+}
+
+static uint64_t flushCost(uint8_t chips) {
+    return dirtyCost + transactionCost + 2 * digitalWriteCost + chips * (transferCost + flushByteCost);
+}
+
+static void benchmark() {
+    // Bit-banged bytes land in the chain like SPI's do
+    pinMode(11, OUTPUT);
+    pinMode(13, OUTPUT);
+    junShiftBegin(latchPin, 2);
+    junShiftSetByte(0, 0x5A);
+    junShiftSetByte(1, 0xC3);
+    digitalWrite(latchPin, LOW);
+    uint64_t bitBang = bitBangByte(0xC3) + bitBangByte(0x5A);
+    digitalWrite(latchPin, HIGH);
+    latchIfRaised(true);
+    check(showsFrame(), "bit-banged bytes didn't reach the chain like SPI's");
+
+    // shiftChain.jun's benchmark: 1000 bytes bit-banged against 500 flushes
+    // of two changed bytes
+    bitBang = 0;
+    for (int i = 0; i < 1000; i++) {
+        bitBang += bitBangByte(i);
+    }
+    uint64_t spi = 0;
+    for (int i = 0; i < 500; i++) {
+        junShiftSetByte(0, i);
+        junShiftSetByte(1, i + 1);
+        flush();
+        spi += 2 * setByteCost + flushCost(2);
+    }
+    double bitBangRate = 1000.0 * F_CPU / bitBang, spiRate = 1000.0 * F_CPU / spi;
+    printf("  shiftChain.jun's benchmark: Io:digWrite %.0f bytes/s, ShiftOut %.0f bytes/s (%.1fx)\n", bitBangRate,
+           spiRate, spiRate / bitBangRate);
+    check(spiRate > 5 * bitBangRate, "ShiftOut isn't much faster than bit-banging");
+
+    for (uint8_t chips : { 1, 2, 8 }) {
+        uint64_t banged = chips * bitBang / 1000 + 2 * digitalWriteCost;
+        printf("  a flush of %u chip%s: %5.1fus, bit-banged %6.1fus, unchanged %.2fus\n", chips,
+               chips == 1 ? "" : "s", flushCost(chips) / 16.0, banged / 16.0, dirtyCost / 16.0);
+    }
+}
+
+int main() {
+    hostSpiByte = spiByte;
+    printf("frames\n");
+    frames();
+    light();
+    printf("speed (estimated)\n");
+    benchmark();
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+# Builds and runs one of the host simulations in this folder, e.g.
+#   python3 sim.py stepper
+# Pulls the C++ block out of the matching lib/<Module>.jun (or modules, in the
+# order they depend on each other), compiles it with <name>Sim.cpp using g++
+# and runs the result. Extra arguments are passed on.
+import os
+import subprocess
+import sys
+
+here = os.path.dirname(os.path.abspath(__file__))
+modules = {
+    "stepper": ["Stepper"],
+    "display": ["Display"],
+    "pixels": ["Pixels"],
+    "edgeCapture": ["EdgeCapture"],
+    "encoder": ["EdgeCapture", "Encoder"],
+    "servo": ["Servo"],
+    "keypad": ["Keypad"],
+    "debounce": ["Debounce"],
+    "fastIo": ["FastIo"],
+    "adcScan": ["AdcScan"],
+    "tone": ["Tone"],
+    "fader": ["Fader"],
+    "softPwm": ["SoftPwm"],
+    "serialOut": ["SerialOut"],
+    "serialIn": ["SerialIn"],
+    "shiftOut": ["ShiftOut"],
+    "i2c": ["I2c"],
+    "pulse": ["Pulse"],
+}
+
+def extract(module):
+    # The module's C++ sits between the first two lines that are just "#"
+    lines = open(os.path.join(here, "..", "lib", module + ".jun")).read().split("\n")
+    start = lines.index("#")
+    end = lines.index("#", start + 1)
+    return "\n".join(lines[start + 1:end]) + "\n"
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in modules:
+        sys.exit("usage: sim.py " + "|".join(modules) + " [args]")
+    name = sys.argv[1]
+    build = os.path.join(here, "build")
+    os.makedirs(build, exist_ok=True)
+    for module in modules[name]:
+        with open(os.path.join(build, module + ".inc"), "w") as f:
+            f.write(extract(module))
+    exe = os.path.join(build, name + "Sim")
+    # Helpers only the module's Juniper functions call go unused here
+    subprocess.check_call(["g++", "-std=c++17", "-O2", "-Wall", "-Wno-unused-function", "-I", build, "-I", here,
+                           "-o", exe, os.path.join(here, name + "Sim.cpp")])
+    sys.exit(subprocess.call([exe] + sys.argv[2:], cwd=build))
+
+main()
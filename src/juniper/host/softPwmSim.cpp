@@ -0,0 +1,356 @@
+// Runs lib/SoftPwm.jun's Timer1 interrupt on the PC with a cycle counted model
+// of the timer, the compare match and the Arduino core's timer0 interrupt, as
+// servoSim.cpp does for Servo. Checks that schedules clear every pin once at
+// its duty, that every pin switches off once a cycle, that every cycle runs
+// on one whole schedule, that duty 0 and 255 pins never switch, that no
+// compare is set too late to fire and that SoftPwm:isrMicros reports what the
+// model measured. Prints the interrupt time per PWM cycle for 8, 16 and 32
+// channels.
+#include "pinChange.h"
+
+// Interrupt times are hand counted estimates, as in pinChange.h. TCNT1 is
+// read at fixed points of the interrupt, so each read moves the clock on by
+// the cycles of the code since the one before:
+// - entry to the first read: respond and jmp ~9, prologue saving ~14
+//   registers and SREG ~31
+// - a cycle start: the schedule and pending check ~12, the swap ~8, the busy
+//   counters and the cycle start ~14, and 14 per port to set the pins
+// - an event: finding it ~10 and 16 per port to clear its pins
+// - after either, the next event, due and OCR1A ~24 up to the loop's read
+// - after the loop, TIFR1 ~3 to the last read; then the busy count ~12,
+//   epilogue and reti ~38
+static const uint32_t entryCost = 40;
+static const uint32_t frameCost = 34, setPerPort = 14;
+static const uint32_t eventCost = 10, clearPerPort = 16;
+static const uint32_t dueCost = 24, exitCost = 3, epilogueCost = 50;
+
+// 32 channels on four ports needs a board with more pins than an Uno
+#define JUN_SOFTPWM_CHANNELS 32
+#define JUN_SOFTPWM_PORTS 4
+
+enum Read { Outside, Entered, Check, Exit };
+static Read nextRead = Outside;
+static uint8_t handling = 0;
+static bool swapping = false;
+static uint64_t cycle = 0;
+
+// Pin switches, with the PWM cycle under way when they happened
+struct Edge {
+    uint64_t at;
+    size_t cycle;
+};
+static std::vector<Edge> rises[JUN_SOFTPWM_CHANNELS], falls[JUN_SOFTPWM_CHANNELS];
+static bool seen[JUN_SOFTPWM_CHANNELS];
+
+// Duties handed to the interrupt, and when each PWM cycle started and the
+// duties it ran with. A cycle can start in the same interrupt as the last
+// switch off of the one before, when that is within the margin of the end.
+static std::vector<uint8_t> committed;
+static std::vector<uint64_t> starts;
+static std::vector<std::vector<uint8_t>> active;
+
+static uint16_t hostTcnt1();
+#define TCNT1 hostTcnt1()
+
+#include "SoftPwm.inc"
+
+static void notePins() {
+    for (uint8_t i = 0; i < junSoftPwmChannelCount; i++) {
+        const JunSoftPwmChannel& c = junSoftPwmChannels[i];
+        bool high = (*junSoftPwmPorts[c.port] & c.mask) != 0;
+        if (high != seen[i]) {
+            (high ? rises : falls)[i].push_back({ cycle, starts.size() - 1 });
+            seen[i] = high;
+        }
+    }
+}
+
+static uint16_t hostTcnt1() {
+    switch (nextRead) {
+        case Entered:
+            nextRead = Check;
+            handling = junSoftPwmNext;
+            swapping = junSoftPwmPending;
+            break;
+        case Check: {
+            // The loop body for the moment handling was at is done
+            if (handling == 0) {
+                // The start can be handled up to the margin early
+                int16_t counts = (uint16_t)(cycle / 64) - junSoftPwmCycleStart;
+                starts.push_back((int64_t)(cycle / 64 - counts) * 64);
+                active.push_back(swapping || active.empty() ? committed : active.back());
+            }
+            cycle += handling == 0 ? frameCost + setPerPort * junSoftPwmPortCount
+                                   : eventCost + clearPerPort * junSoftPwmPortCount;
+            notePins();
+            cycle += dueCost;
+            uint16_t now = cycle / 64;
+            if ((int16_t)(OCR1A - now) <= JUN_SOFTPWM_MARGIN) {
+                handling = junSoftPwmNext;
+                swapping = junSoftPwmPending;
+            } else {
+                nextRead = Exit;
+            }
+            return now;
+        }
+        case Exit:
+            cycle += exitCost;
+            nextRead = Outside;
+            break;
+        case Outside:
+            break;
+    }
+    return cycle / 64;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+static uint8_t megaPorts[JUN_SOFTPWM_PORTS];
+
+// A fresh board. With pins, attach does the set up; without, it's what attach
+// would set up for 8 pins on each of four ports.
+static void fresh(const std::vector<uint8_t>& pins, uint8_t channels) {
+    memset(junSoftPwmChannels, 0, sizeof(junSoftPwmChannels));
+    junSoftPwmChannelCount = 0;
+    junSoftPwmPortCount = 0;
+    junSoftPwmStarted = false;
+    junSoftPwmFront = 0;
+    junSoftPwmPending = false;
+    junSoftPwmBusy = junSoftPwmLastBusy = 0;
+    memset(hostIo, 0, sizeof(hostIo));
+    memset(megaPorts, 0, sizeof(megaPorts));
+    memset(seen, 0, sizeof(seen));
+    for (auto& r : rises) r.clear();
+    for (auto& f : falls) f.clear();
+    starts.clear();
+    active.clear();
+    cycle = 1000;
+    nextRead = Outside;
+    if (!pins.empty()) {
+        for (uint8_t p : pins) {
+            check(junSoftPwmAttach(p), "attach refused a free pin");
+        }
+        return;
+    }
+    junSoftPwmStart();
+    for (uint8_t i = 0; i < channels; i++) {
+        JunSoftPwmChannel& c = junSoftPwmChannels[i];
+        c.pin = 100 + i;
+        c.port = i / 8;
+        c.mask = 1 << (i % 8);
+        junSoftPwmPorts[c.port] = &megaPorts[c.port];
+    }
+    junSoftPwmChannelCount = channels;
+    junSoftPwmPortCount = (channels + 7) / 8;
+}
+
+struct Result {
+    // Switch off against the duty, in us
+    double earliest, latest;
+    // Interrupt time per PWM cycle as the model counted it, and the most
+    // SoftPwm:isrMicros reported
+    double meanIsr, worstIsr;
+    uint16_t reported;
+    uint32_t missed, mixed, stuck, skipped;
+};
+
+// Runs cycles PWM cycles with duty(cycle, channel) written from loop() half
+// way through every cycle
+template<typename Duty>
+static Result run(uint8_t channels, uint32_t cycles, Duty duty) {
+    committed.assign(channels, 0);
+    for (uint8_t i = 0; i < channels; i++) {
+        junSoftPwmWrite(junSoftPwmChannels[i].pin, duty(0, i));
+        committed[i] = junSoftPwmChannels[i].duty;
+    }
+
+    Result r = { 1e9, -1e9, 0, 0, 0, 0, 0, 0, 0 };
+    // Interrupt cycles, by the PWM cycle each interrupt began in
+    std::vector<uint64_t> isrCycles(cycles + 2, 0);
+    uint64_t compare = (uint64_t)OCR1A * 64;
+    uint64_t cpu = cycle, overflows = cycle / timer0Period;
+    size_t written = 0;
+    while (starts.size() <= cycles) {
+        uint64_t timerFlag = (overflows + 1) * timer0Period;
+        uint64_t pwmTaken = compare > cpu ? compare : cpu;
+        uint64_t timerTaken = timerFlag > cpu ? timerFlag : cpu;
+        // Timer1 COMPA comes before TIMER0_OVF when both are waiting
+        if (pwmTaken <= timerTaken) {
+            size_t before = starts.size();
+            cycle = pwmTaken + entryCost;
+            nextRead = Entered;
+            TIMER1_COMPA_vect_host();
+            uint16_t now = cycle / 64;
+            uint16_t ahead = OCR1A - now;
+            if (ahead == 0 || ahead > 256) {
+                r.missed++;
+            }
+            compare = ((uint64_t)(cycle / 64) + (ahead == 0 ? 65536 : ahead)) * 64;
+            cycle += epilogueCost;
+            isrCycles[std::min(before, (size_t)cycles + 1)] += cycle - pwmTaken;
+            cpu = cycle + 1;
+            if (starts.size() > before && starts.size() > 3) {
+                r.reported = std::max(r.reported, junSoftPwmIsrMicros());
+            }
+        } else {
+            overflows++;
+            cpu = timerTaken + timer0Cost + 1;
+        }
+        if (written < starts.size() && starts.size() < cycles && cpu >= starts.back() + 128 * 64) {
+            cycle = cpu;
+            nextRead = Outside;
+            for (uint8_t i = 0; i < channels; i++) {
+                junSoftPwmWrite(junSoftPwmChannels[i].pin, duty(starts.size(), i));
+                committed[i] = junSoftPwmChannels[i].duty;
+            }
+            written = starts.size();
+        }
+    }
+
+    // The first cycle runs the empty schedule from start, so pins go high
+    // from the second
+    for (uint8_t i = 0; i < channels; i++) {
+        std::vector<uint32_t> perCycle(active.size(), 0);
+        for (const Edge& fall : falls[i]) {
+            size_t at = fall.cycle;
+            perCycle[at]++;
+            uint8_t d = active[at][i];
+            if (d == 0 || d == 255) {
+                r.stuck++;
+                continue;
+            }
+            double late = (fall.at - (starts[at] + d * 64.0)) / 16;
+            r.earliest = std::min(r.earliest, late);
+            r.latest = std::max(r.latest, late);
+            // A duty from another schedule puts the switch off well away
+            if (late < -4.0 * JUN_SOFTPWM_MARGIN - 1 || late > 1024) {
+                r.mixed++;
+            }
+        }
+        for (const Edge& rise : rises[i]) {
+            r.stuck += active[rise.cycle][i] == 0;
+        }
+        // Every whole cycle switches a pin between 0 and 255 off exactly once
+        for (size_t k = 1; k + 1 < active.size(); k++) {
+            uint8_t d = active[k][i];
+            r.skipped += perCycle[k] != (d != 0 && d != 255);
+        }
+    }
+    // The interrupts of each whole PWM cycle, in us
+    double total = 0;
+    for (size_t k = 2; k <= cycles; k++) {
+        total += isrCycles[k] / 16.0;
+        r.worstIsr = std::max(r.worstIsr, isrCycles[k] / 16.0);
+    }
+    r.meanIsr = total / (cycles - 1);
+    return r;
+}
+
+static void report(const char* name, const Result& r) {
+    printf("  %-30s %6.1fus a cycle (%4.1f%% of the CPU), worst %6.1fus, isrMicros up to %3u; switch off "
+           "%4.1f to %5.1fus late\n", name, r.meanIsr, r.meanIsr / 10.24, r.worstIsr, r.reported, r.earliest,
+           r.latest);
+    check(r.missed == 0, "OCR1A set after the count had passed it");
+    check(r.mixed == 0, "a cycle ran with duties from another schedule");
+    check(r.stuck == 0, "a pin at duty 0 or 255 switched");
+    check(r.skipped == 0, "a pin wasn't switched off exactly once in a cycle");
+    check(r.reported <= r.worstIsr, "isrMicros over the whole interrupt time");
+}
+
+// Checks a schedule built from duties against the rules in junSoftPwmRebuild
+static void checkSchedule(const std::vector<uint8_t>& duties) {
+    const JunSoftPwmSchedule& s = junSoftPwmSchedules[junSoftPwmFront ^ 1];
+    uint32_t cleared[JUN_SOFTPWM_CHANNELS] = {};
+    for (uint8_t k = 0; k < s.count; k++) {
+        const JunSoftPwmEvent& e = s.events[k];
+        if (k > 0) {
+            check(e.time > s.events[k - 1].time, "events out of order or not merged");
+        }
+        for (uint8_t i = 0; i < duties.size(); i++) {
+            const JunSoftPwmChannel& c = junSoftPwmChannels[i];
+            if (e.clear[c.port] & c.mask) {
+                cleared[i]++;
+                check(e.time == duties[i], "pin cleared away from its duty");
+            }
+        }
+    }
+    for (uint8_t i = 0; i < duties.size(); i++) {
+        const JunSoftPwmChannel& c = junSoftPwmChannels[i];
+        bool switching = duties[i] > 0 && duties[i] < 255;
+        check(cleared[i] == (switching ? 1u : 0u), "pin not cleared exactly once");
+        check(((s.set[c.port] & c.mask) != 0) == (duties[i] > 0), "pin set at the cycle start wrongly");
+    }
+}
+
+// softPwm.jun's triangle wave along the pins, moved on every 20 cycles
+static uint8_t wave(uint32_t n, uint8_t i) {
+    uint8_t x = n / 20 * 4 + i * 32;
+    return x < 128 ? x * 2 : (255 - x) * 2;
+}
+
+int main() {
+    // Schedules for random duties, some of them the same, 0 or 255
+    srand(1);
+    fresh({}, 32);
+    uint32_t events = 0, schedules = 10000;
+    for (uint32_t n = 0; n < schedules; n++) {
+        std::vector<uint8_t> duties;
+        for (uint8_t i = 0; i < 32; i++) {
+            junSoftPwmChannels[i].duty = n % 2 ? rand() % 8 * 32 + (rand() % 3 == 0) * 31 : rand() % 256;
+            duties.push_back(junSoftPwmChannels[i].duty);
+        }
+        junSoftPwmRebuild();
+        checkSchedule(duties);
+        events += junSoftPwmSchedules[junSoftPwmFront ^ 1].count;
+    }
+    printf("%u schedules of 32 duties checked, %.1f switch off moments each after merging\n", schedules,
+           (double)events / schedules);
+
+    // Attach on softPwm.jun's pins: pins on one port share it
+    fresh({ 2, 4, 7, 8, 9, 10, 11, 12 }, 0);
+    check(junSoftPwmPortCount == 2 && junSoftPwmChannelCount == 8, "softPwm.jun's pins don't share two ports");
+    check((DDRD & 0x94) == 0x94 && (DDRB & 0x1F) == 0x1F, "attach didn't make the pins outputs");
+    junSoftPwmWrite(2, 100);
+    bool pending = junSoftPwmPending;
+    junSoftPwmPending = false;
+    junSoftPwmWrite(2, 100);
+    check(pending && !junSoftPwmPending, "writing the same duty rebuilt the schedule");
+
+    printf("interrupt cost (estimated): %u cycles to start a cycle and %u for a lone switch off, with 4 ports\n",
+           entryCost + frameCost + 4 * setPerPort + dueCost + exitCost + epilogueCost,
+           entryCost + eventCost + 4 * clearPerPort + dueCost + exitCost + epilogueCost);
+    printf("interrupt time per 1024us PWM cycle\n");
+    auto random = [](uint32_t, uint8_t) { return (uint8_t)(rand() % 256); };
+    auto apart = [](uint32_t, uint8_t i) { return (uint8_t)(8 + i * 7); };
+    auto same = [](uint32_t, uint8_t) { return (uint8_t)128; };
+    // 8: softPwm.jun's pins; 16: an Uno's 2-13 and A0-A3 on three ports;
+    // 32: four ports of 8
+    const std::vector<uint8_t> uno8 = { 2, 4, 7, 8, 9, 10, 11, 12 };
+    const std::vector<uint8_t> uno16 = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17 };
+    for (uint8_t channels : { 8, 16, 32 }) {
+        const std::vector<uint8_t> none;
+        const std::vector<uint8_t>& pins = channels == 8 ? uno8 : channels == 16 ? uno16 : none;
+        char name[64];
+        fresh(pins, channels);
+        snprintf(name, sizeof(name), "%u, softPwm.jun's wave", channels);
+        report(name, run(channels, 400, wave));
+        fresh(pins, channels);
+        snprintf(name, sizeof(name), "%u, all apart", channels);
+        report(name, run(channels, 100, apart));
+        fresh(pins, channels);
+        snprintf(name, sizeof(name), "%u, random every cycle", channels);
+        report(name, run(channels, 400, random));
+        fresh(pins, channels);
+        snprintf(name, sizeof(name), "%u, all at 128", channels);
+        report(name, run(channels, 100, same));
+    }
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
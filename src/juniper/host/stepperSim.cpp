@@ -0,0 +1,119 @@
+// Runs lib/Stepper.jun's tick on the PC for a set of moves and checks that
+// each one ends on target in a sensible time, never beats the top speed and
+// keeps cruising step periods within 10% of exact. Prints one line per move
+// and exits with 1 if any check fails.
+#include "avrHost.h"
+
+#include "Stepper.inc"
+
+static uint8_t stepPort = 0;
+static uint8_t dirPort = 0;
+static int failures = 0;
+
+struct Move {
+    const char* name;
+    uint32_t maxSpeed;
+    uint32_t accel;
+    uint32_t jerk;
+    int32_t target;
+    // Second target, set when the first brake starts (or at retargetTick)
+    int32_t retarget;
+    long retargetTick;
+};
+
+struct Result {
+    long ticks;
+    int32_t position;
+    long resumes;
+    long minGap;
+    // Worst difference between a step period and the exact period for the
+    // speed, as a fraction of the exact period, while cruising
+    double jitter;
+};
+
+static Result run(const Move& m, int32_t target, int32_t retarget, long retargetTick) {
+    JunStepperAxis& a = junStepperAxes[0];
+    memset(&a, 0, sizeof(a));
+    a.stepPort = &stepPort;
+    a.dirPort = &dirPort;
+    a.stepMask = 1;
+    a.dirMask = 1;
+    junStepperSetProfile(0, m.maxSpeed, m.accel, m.jerk);
+    a.target = target;
+    Result r = { 0, 0, 0, 1L << 30, 0 };
+    long lastStep = -1;
+    bool retargeted = retarget == target;
+    for (; r.ticks < 20L * (long)JUN_STEPPER_HZ; r.ticks++) {
+        uint8_t before = a.state;
+        int32_t position = a.position;
+        junStepperTick(a);
+        if (before >= JUN_STEPPER_BRAKE_UP && a.state != JUN_STEPPER_IDLE && a.state <= JUN_STEPPER_RAMP_DOWN) {
+            r.resumes++;
+        }
+        if (a.position != position) {
+            long gap = r.ticks - lastStep;
+            if (lastStep >= 0 && gap < r.minGap) {
+                r.minGap = gap;
+            }
+            if (lastStep >= 0 && before == JUN_STEPPER_CRUISE && a.state == JUN_STEPPER_CRUISE) {
+                double exact = (double)JUN_STEPPER_ONE_STEP / a.speed;
+                double error = (gap > exact ? gap - exact : exact - gap) / exact;
+                if (error > r.jitter) {
+                    r.jitter = error;
+                }
+            }
+            lastStep = r.ticks;
+        }
+        if (!retargeted && (retargetTick >= 0 ? r.ticks == retargetTick : a.state >= JUN_STEPPER_BRAKE_UP)) {
+            a.target = retarget;
+            retargeted = true;
+        }
+        if (retargeted && a.state == JUN_STEPPER_IDLE && a.position == a.target) {
+            break;
+        }
+    }
+    r.position = a.position;
+    return r;
+}
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    const Move moves[] = {
+        { "trapezoid", 1000, 500, 0, 4000, 4000, -1 },
+        { "s curve", 1000, 500, 10000, 4000, 4000, -1 },
+        { "uneven period", 900, 2000, 0, 4000, 4000, -1 },
+        { "slow", 130, 200, 0, 500, 500, -1 },
+        { "short move", 1000, 500, 0, 100, 100, -1 },
+        { "tiny s curve", 1000, 500, 5000, 10, 10, -1 },
+        { "capped reverse", 5000, 20000, 0, -3000, -3000, -1 },
+        { "turn round", 1000, 500, 0, 2500, -200, 4000 },
+        { "retarget braking", 1000, 500, 0, 1000, 3000, -1 },
+        { "retarget braking s", 1000, 500, 10000, 1000, 3000, -1 },
+    };
+    for (const Move& m : moves) {
+        Result r = run(m, m.target, m.retarget, m.retargetTick);
+        uint32_t top = m.maxSpeed < JUN_STEPPER_MAX_SPEED ? m.maxSpeed : JUN_STEPPER_MAX_SPEED;
+        printf("%-20s end %6d target %6d  %6.2fs  fastest %ld ticks/step  jitter %4.1f%%  resumes %ld\n",
+               m.name, r.position, m.retarget, r.ticks / (double)JUN_STEPPER_HZ, r.minGap, r.jitter * 100, r.resumes);
+        check(r.position == m.retarget, "did not stop on target");
+        check((uint64_t)r.minGap * top + top >= JUN_STEPPER_HZ, "went faster than the top speed");
+        check(r.jitter <= 0.1 + 1e-6, "step periods more than 10% off while cruising");
+        if (m.retarget == m.target || m.retargetTick >= 0) {
+            check(r.resumes == 0, "sped up again while braking for a fixed target");
+        } else {
+            // Braking for 2000 then heading on to 6000 should cost little
+            // more than going straight to 6000
+            Result direct = run(m, m.retarget, m.retarget, -1);
+            printf("%-20s straight to %d takes %.2fs\n", "", m.retarget, direct.ticks / (double)JUN_STEPPER_HZ);
+            check(r.ticks < direct.ticks * 5 / 4, "retargeted move much slower than a direct one");
+        }
+    }
+    printf(failures == 0 ? "all moves passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
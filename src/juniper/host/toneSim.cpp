@@ -0,0 +1,265 @@
+// Runs lib/Tone.jun's Timer2 interrupts on the PC against a model of Timer2
+// in CTC and fast PWM mode. In square wave mode, checks the frequency and
+// length of every note, that rests stay silent and that the queue holds what
+// the header says. In wave mode, checks the pitch and the shape of the
+// samples. Then works out the CPU the interrupts take against buzzer.jun,
+// which waits out every edge.
+#include "avrHost.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Tone.inc"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok && failures++ < 20) {
+        printf("  FAILED: %s\n", what);
+    }
+}
+
+// Interrupt times are hand counted estimates: respond, jmp, prologue and
+// epilogue ~60; the pin toggle through junTonePort ~10 and the 32-bit
+// count down ~16; in wave mode the phase, the wave switch and the sample
+// ~40 instead of the toggle. junToneNext ~120, and in square wave mode each
+// prescaler junToneCtc tries costs a 32-bit divide, ~650.
+static const uint32_t squareIsr = 86, waveIsr = 116;
+static const uint32_t nextCost = 120, divideCost = 650;
+
+static const uint16_t prescalers[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+static uint64_t cycle = 0, timerStart = 0, isrCycles = 0, worstIsr = 0, ended = 0;
+
+// Pin 12, PORTB bit 4, as in buzzer.jun
+static const uint8_t buzzerPin = 12, buzzerMask = 1 << 4;
+
+struct Edge {
+    uint64_t at;
+    bool high;
+};
+static std::vector<Edge> edges;
+// When each note started, from junToneNext taking it off the queue
+static std::vector<uint64_t> starts;
+// Wave mode: the duty cycle each PWM period ran at, and the phase it came
+// from
+static std::vector<uint8_t> samples;
+static std::vector<uint16_t> phases;
+
+static bool wave() {
+    return (TCCR2A & (1 << WGM20)) != 0;
+}
+
+static uint64_t nextInterrupt() {
+    uint32_t prescale = prescalers[TCCR2B & 0x07];
+    return timerStart + (uint64_t)(wave() ? 256 : OCR2A + 1) * prescale;
+}
+
+// Calls into Tone with TCNT2 set away from 0, to see whether the call
+// restarts the timer, and notes where the queue moved on
+template<typename F>
+static void call(F f, uint32_t cost) {
+    uint8_t tail = junToneTail;
+    bool playing = junTonePlaying;
+    uint8_t port = PORTB;
+    TCNT2 = 1;
+    f();
+    if (playing && !junTonePlaying) {
+        ended = cycle;
+    }
+    if (junToneTail != tail || (junTonePlaying && !playing)) {
+        starts.push_back(cycle);
+        cost += nextCost + (junToneMode == JUN_TONE_SQUARE && !junToneResting ? divideCost * (TCCR2B & 0x07) : 0);
+    }
+    if (TCNT2 == 0) {
+        timerStart = cycle;
+    }
+    if ((port ^ PORTB) & buzzerMask) {
+        edges.push_back({ cycle, (PORTB & buzzerMask) != 0 });
+    }
+    isrCycles += cost;
+    worstIsr = std::max(worstIsr, (uint64_t)cost);
+}
+
+static void run(uint64_t until) {
+    // Timer2 runs on whether or not it interrupts
+    while (TCCR2B != 0 && nextInterrupt() <= cycle) {
+        timerStart = nextInterrupt();
+    }
+    while (TIMSK2 != 0 && nextInterrupt() <= until) {
+        cycle = timerStart = nextInterrupt();
+        if (wave()) {
+            // OCR2B is double buffered in PWM mode and takes the value the
+            // last interrupt left at the bottom
+            samples.push_back(OCR2B);
+            phases.push_back(junTonePhase);
+            if (TIMSK2 & (1 << TOIE2)) {
+                call(TIMER2_OVF_vect_host, waveIsr);
+            }
+        } else if (TIMSK2 & (1 << OCIE2A)) {
+            call(TIMER2_COMPA_vect_host, squareIsr);
+        }
+    }
+    cycle = until;
+}
+
+static void reset() {
+    edges.clear();
+    starts.clear();
+    samples.clear();
+    phases.clear();
+    isrCycles = worstIsr = 0;
+}
+
+static uint64_t ms(double t) {
+    return (uint64_t)(t * (F_CPU / 1000));
+}
+
+static void queue() {
+    check(!junTonePlay(440, 100), "a note queued before begin");
+    check(TIMSK2 == 0, "Timer2 started before begin");
+
+    call([] { junToneBegin(buzzerPin); }, 0);
+    check(DDRB & buzzerMask, "begin didn't make the pin an output");
+    uint32_t taken = 0;
+    while (taken < 100 && junTonePlay(1000, 10)) {
+        taken++;
+    }
+    printf("  queue of %u: %u notes taken, one playing and %u waiting\n", JUN_TONE_QUEUE, taken,
+           (junToneHead + JUN_TONE_QUEUE - junToneTail) % JUN_TONE_QUEUE);
+    check(taken == JUN_TONE_QUEUE, "the queue didn't take one playing note and JUN_TONE_QUEUE - 1 more");
+
+    run(cycle + ms(25));
+    call(junToneStop, 0);
+    check(!junTonePlaying && TIMSK2 == 0 && !(PORTB & buzzerMask), "stop left the tone running or the pin high");
+    run(cycle + ms(100));
+    check(!junTonePlaying, "a note played after stop");
+}
+
+static void square() {
+    struct Note {
+        uint16_t hz, ms;
+    };
+    // buzzerTone.jun's two tones, a rest, then a sweep
+    static const Note notes[] = { { 500, 160 }, { 250, 400 }, { 0, 50 }, { 31, 500 }, { 100, 200 }, { 262, 200 },
+                                  { 440, 200 }, { 1000, 100 }, { 2093, 100 }, { 4186, 100 }, { 5000, 50 } };
+    const uint32_t count = sizeof(notes) / sizeof(notes[0]);
+    call([] { junToneBegin(buzzerPin); }, 0);
+    reset();
+    uint64_t begun = cycle;
+    for (const Note& n : notes) {
+        call([&] { junTonePlay(n.hz, n.ms); }, 0);
+    }
+    run(cycle + ms(3000));
+    check(starts.size() == count, "not every note started");
+    check(!junTonePlaying && TIMSK2 == 0 && !(PORTB & buzzerMask), "the tone didn't stop after the queue");
+    starts.push_back(ended);
+
+    printf("    hz      ms   played hz  error   played ms\n");
+    for (uint32_t i = 0; i < count && i + 1 < starts.size(); i++) {
+        uint64_t from = starts[i], to = starts[i + 1];
+        std::vector<uint64_t> rises;
+        uint32_t inside = 0;
+        for (const Edge& e : edges) {
+            if (e.at > from && e.at <= to) {
+                inside++;
+                if (e.high) rises.push_back(e.at);
+            }
+        }
+        double played = (to - from) * 1000.0 / F_CPU;
+        if (notes[i].hz == 0) {
+            printf("  rest  %4u              -         %7.2f\n", notes[i].ms, played);
+            check(inside == 0, "the pin moved during a rest");
+            check(std::fabs(played - notes[i].ms) <= 1, "a rest is the wrong length");
+            continue;
+        }
+        double hz = rises.size() < 2 ? 0 : (rises.size() - 1) * (double)F_CPU / (rises.back() - rises.front());
+        double error = (hz - notes[i].hz) / notes[i].hz;
+        printf("  %5u  %4u   %9.2f  %+5.2f%%   %7.2f\n", notes[i].hz, notes[i].ms, hz, 100 * error, played);
+        check(std::fabs(error) < 0.01, "a note is more than 1% off pitch");
+        // Notes are a whole number of half periods
+        check(std::fabs(played - notes[i].ms) <= 500.0 / notes[i].hz + notes[i].ms * 0.01,
+              "a note is the wrong length");
+    }
+    double total = (starts.back() - begun) * 1000.0 / F_CPU;
+    printf("  %u notes in %.1fms, interrupts took %.2f%% of the CPU (estimated), the longest %.0fus at a note "
+           "change\n", count, total, 100.0 * isrCycles / (starts.back() - begun), worstIsr * 1e6 / F_CPU);
+}
+
+static void pattern() {
+    call([] { junToneBegin(buzzerPin); }, 0);
+    reset();
+    uint64_t begun = cycle;
+    call([] { junTonePlay(500, 160); }, 0);
+    call([] { junTonePlay(250, 400); }, 0);
+    run(cycle + ms(600));
+    double share = 100.0 * isrCycles / (ended - begun);
+    printf("  buzzerTone.jun's pattern: interrupts %.2f%% of the CPU (estimated), loop() gets the other %.2f%%; "
+           "buzzer.jun waits for every edge, 0%% left\n", share, 100 - share);
+    check(share < 2, "the square wave interrupts take more than 2% of the CPU");
+}
+
+static double ideal(uint8_t shape, uint16_t phase) {
+    double x = phase / 65536.0;
+    switch (shape) {
+        case 0: return 127.5 + 127.5 * std::sin(2 * M_PI * x);
+        case 1: return x < 0.5 ? 510 * x : 510 * (1 - x);
+        case 2: return 255 * x;
+        default: return x < 0.5 ? 255 : 0;
+    }
+}
+
+static void waves() {
+    static const char* names[4] = { "sine", "triangle", "saw", "square" };
+    // The sine table has 64 steps, the others lose the phase's low bits
+    static const double tolerance[4] = { 13, 2.5, 1.5, 0.5 };
+    for (uint8_t shape = 0; shape < 4; shape++) {
+        call([&] { junToneBeginWave(shape); }, 0);
+        check(TCCR2A == ((1 << COM2B1) | (1 << WGM21) | (1 << WGM20)), "beginWave didn't set fast PWM on OC2B");
+        reset();
+        uint64_t begun = cycle;
+        call([] { junTonePlay(440, 500); }, 0);
+        call([] { junTonePlay(0, 20); }, 0);
+        run(cycle + ms(600));
+
+        // The first sample is still the one from before play
+        uint32_t played = 0, off = 0, crossings = 0, first = 0, last = 0;
+        // samples[i] was worked out at phases[i] by the interrupt before
+        for (size_t i = 1; i < samples.size(); i++) {
+            if (i <= 3906) {
+                played++;
+                off += std::fabs(samples[i] - ideal(shape, phases[i])) > tolerance[shape];
+                if (phases[i] < phases[i - 1]) {
+                    first = first ? first : i;
+                    last = i;
+                    crossings++;
+                }
+            } else {
+                off += samples[i] != 0;
+            }
+        }
+        double hz = (crossings - 1) * 7812.5 / (last - first);
+        printf("  %-8s 440Hz: %u samples (%.2fms) at %.2fHz, %u samples off the wave or sounding in the rest\n",
+               names[shape], played, played / 7.8125, hz, off);
+        check(std::fabs(hz - 440) < 0.5, "a synthesized note is off pitch");
+        check(off == 0, "a sample is off the wave shape");
+        check(!junTonePlaying && TIMSK2 == 0, "wave mode didn't stop after the queue");
+        if (shape == 0) {
+            double share = 100.0 * isrCycles / (ended - begun);
+            printf("  wave mode: an interrupt every 128us, %.1f%% of the CPU while playing (estimated)\n", share);
+        }
+    }
+}
+
+int main() {
+    printf("queue\n");
+    queue();
+    printf("square wave\n");
+    square();
+    pattern();
+    printf("wave\n");
+    waves();
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}